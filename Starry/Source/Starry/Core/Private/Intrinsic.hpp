@@ -376,10 +376,7 @@ namespace se
 	 */
 	[[nodiscard]][[msvc::forceinline]] static float4 floor(float4 const& xmm) noexcept
 	{
-		float4 trunc = _mm_cvtepi32_ps(_mm_cvttps_epi32(xmm));
-		float4 mask = _mm_cmpge_ps(xmm, _mm_setzero_ps());
-		float4 sub = _mm_blendv_ps(_mm_set_ps1(1), _mm_setzero_ps(), mask);
-		return _mm_sub_ps(trunc, sub);
+		return _mm_round_ps(xmm, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); // SSE4.1
 	}
 
 	/**
@@ -387,10 +384,7 @@ namespace se
 	 */
 	[[nodiscard]][[msvc::forceinline]] static float4 ceil(float4 const& xmm) noexcept
 	{
-		__m128 trunc = _mm_cvtepi32_ps(_mm_cvttps_epi32(xmm));
-		__m128 mask = _mm_cmpge_ps(xmm, _mm_setzero_ps());
-		__m128 add = _mm_blendv_ps(_mm_setzero_ps(), _mm_set_ps1(1), mask);
-		return _mm_add_ps(trunc, add);
+		return _mm_round_ps(xmm, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC); // SSE4.1
 	}
 
 	/**
@@ -491,22 +485,22 @@ namespace se
 
 	[[nodiscard]][[msvc::forceinline]] static int4 load(const int* ptr) noexcept
 	{
-		return _mm_load_si128((const int4*)ptr);
+		return _mm_loadu_si128((const int4*)ptr);
 	}
 
 	[[msvc::forceinline]] static void store(int4 const& xmm, int* to) noexcept
 	{
-		_mm_store_si128((int4*)to, xmm);
+		_mm_storeu_si128((int4*)to, xmm);
 	}
 
 	[[nodiscard]][[msvc::forceinline]] static int4 load_aligned(const int* ptr) noexcept
 	{
-		return _mm_loadu_si128((const int4*)ptr);
+		return _mm_load_si128((const int4*)ptr);
 	}
 
-	[[msvc::forceinline]] static void store_aligned(int4 const& xmm, float* to) noexcept
+	[[msvc::forceinline]] static void store_aligned(int4 const& xmm, int* to) noexcept
 	{
-		_mm_storeu_si128((int4*)to, xmm);
+		_mm_store_si128((int4*)to, xmm);
 	}
 
 	template<int i>
@@ -741,6 +735,15 @@ namespace se
 		return _mm_srai_epi32(xmm, bits);
 	}
 
+	/**
+	 * @brief Returns an integer bit-mask (0x0000 - 0xffff) of the non-zero bytes.
+	 * @return Bit i = (byte i != 0)
+	 */
+	[[nodiscard]][[msvc::forceinline]] static int nonzero_byte_masks(int4 const& xmm) noexcept
+	{
+		return ~_mm_movemask_epi8(_mm_cmpeq_epi8(xmm, _mm_setzero_si128())) & 0xffff;
+	}
+
 	/**
 	 * @brief Returns an integer bit-mask (0x00 - 0x0f) based on the sign-bit for each elements.
 	 * @return Bit 0 = sign(xmm.x), Bit 1 = sign(xmm.y), Bit 2 = sign(xmm.z), Bit 3 = sign(xmm.w)
@@ -0,0 +1,145 @@
+﻿// Copyright (c) 2024 Fong ZiSing. All rights reserved.
+//
+//     ThreadPool.cpp
+//
+
+#include "Starry/Core/Public/ThreadPool.hpp"
+
+
+
+namespace se
+{
+	namespace
+	{
+		thread_local bool is_pool_worker = false;
+	}
+
+
+
+	thread_pool::thread_pool(std::size_t num_threads)
+	{
+		num_threads = num_threads > 1 ? num_threads : 1;
+		workers.reserve(num_threads - 1);
+		for (std::size_t i = 1; i < num_threads; ++i)
+		{
+			workers.emplace_back(&thread_pool::worker_loop, this);
+		}
+	}
+
+
+
+	thread_pool::~thread_pool()
+	{
+		{
+			std::lock_guard lock{ mutex };
+			stopping = true;
+		}
+		wake_condition.notify_all();
+
+		for (std::thread& worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+
+
+	void thread_pool::parallel_for(std::size_t in_num_tasks, std::function<void(std::size_t)> const& callable)
+	{
+		if (in_num_tasks == 0)
+		{
+			return;
+		}
+
+		// Runs serially if there is nothing to share, or if called from a task, or if another batch is in flight.
+		std::unique_lock dispatch_lock{ dispatch_mutex, std::defer_lock };
+		if (workers.empty() || in_num_tasks == 1 || is_pool_worker || !dispatch_lock.try_lock())
+		{
+			for (std::size_t i = 0; i < in_num_tasks; ++i)
+			{
+				callable(i);
+			}
+			return;
+		}
+
+		{
+			std::unique_lock lock{ mutex };
+			done_condition.wait(lock, [this] { return active_workers == 0; });
+
+			task = &callable;
+			num_tasks = in_num_tasks;
+			next_task.store(0, std::memory_order_relaxed);
+			remaining_tasks.store(in_num_tasks, std::memory_order_relaxed);
+			++generation;
+		}
+		wake_condition.notify_all();
+
+		is_pool_worker = true;
+		run_tasks();
+		is_pool_worker = false;
+
+		std::unique_lock lock{ mutex };
+		done_condition.wait(lock, [this] { return remaining_tasks.load(std::memory_order_acquire) == 0; });
+		task = nullptr;
+	}
+
+
+
+	thread_pool& thread_pool::global()
+	{
+		static thread_pool pool;
+		return pool;
+	}
+
+
+
+	void thread_pool::worker_loop()
+	{
+		is_pool_worker = true;
+		uint64_t seen_generation = 0;
+
+		while (true)
+		{
+			{
+				std::unique_lock lock{ mutex };
+				wake_condition.wait(lock, [this, seen_generation] { return stopping || generation != seen_generation; });
+				if (stopping)
+				{
+					return;
+				}
+				seen_generation = generation;
+				++active_workers;
+			}
+
+			run_tasks();
+
+			{
+				std::lock_guard lock{ mutex };
+				--active_workers;
+			}
+			done_condition.notify_all();
+		}
+	}
+
+
+
+	void thread_pool::run_tasks()
+	{
+		while (true)
+		{
+			std::size_t index = next_task.fetch_add(1, std::memory_order_relaxed);
+			if (index >= num_tasks)
+			{
+				return;
+			}
+
+			(*task)(index);
+
+			if (remaining_tasks.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				std::lock_guard lock{ mutex };
+				done_condition.notify_all();
+			}
+		}
+	}
+}
\ No newline at end of file
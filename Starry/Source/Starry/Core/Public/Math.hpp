@@ -29,6 +29,41 @@ namespace se::math
 		return val * val * val;
 	}
 
+	/**
+	 * @brief Interleaves the bits of two 16-bit coordinates into a 32-bit Z-order (Morton) code.
+	 * @return ... y1 x1 y0 x0
+	 */
+	[[nodiscard]][[msvc::forceinline]] static constexpr uint32_t morton_encode(uint16_t x, uint16_t y) noexcept
+	{
+		const auto spread = [](uint32_t v)
+			{
+				v = (v | (v << 8)) & 0x00ff00ffu;
+				v = (v | (v << 4)) & 0x0f0f0f0fu;
+				v = (v | (v << 2)) & 0x33333333u;
+				v = (v | (v << 1)) & 0x55555555u;
+				return v;
+			};
+		return spread(x) | (spread(y) << 1);
+	}
+
+	/**
+	 * @brief Interleaves the bits of three 10-bit coordinates into a 30-bit Z-order (Morton) code.
+	 * @return ... z1 y1 x1 z0 y0 x0
+	 */
+	[[nodiscard]][[msvc::forceinline]] static constexpr uint32_t morton_encode(uint16_t x, uint16_t y, uint16_t z) noexcept
+	{
+		const auto spread = [](uint32_t v)
+			{
+				v &= 0x3ffu;
+				v = (v | (v << 16)) & 0x030000ffu;
+				v = (v | (v << 8)) & 0x0300f00fu;
+				v = (v | (v << 4)) & 0x030c30c3u;
+				v = (v | (v << 2)) & 0x09249249u;
+				return v;
+			};
+		return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+	}
+
 	/**
 	 * @brief Inverts the sign bit conditionally.
 	 */
@@ -0,0 +1,85 @@
+﻿// Copyright (c) 2024 Fong ZiSing. All rights reserved.
+//
+//     ThreadPool.hpp
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+
+
+namespace se
+{
+	/**
+	 * @brief A fixed set of worker threads executing fork-join batches of tasks.
+	 * @details 线程池
+	 */
+	class thread_pool
+	{
+	private:
+		std::vector<std::thread> workers;
+		std::mutex dispatch_mutex;
+		std::mutex mutex;
+		std::condition_variable wake_condition;
+		std::condition_variable done_condition;
+
+		// Current batch, only written while no worker is active.
+		std::function<void(std::size_t)> const* task = nullptr;
+		std::size_t num_tasks = 0;
+		std::atomic<std::size_t> next_task = 0;
+		std::atomic<std::size_t> remaining_tasks = 0;
+		std::size_t active_workers = 0;
+		uint64_t generation = 0;
+		bool stopping = false;
+
+
+	public:
+		/**
+		 * @param num_threads The total number of threads that execute a batch, including the calling thread.
+		 */
+		explicit thread_pool(std::size_t num_threads = std::thread::hardware_concurrency());
+
+		~thread_pool();
+
+		/**
+		 * @brief Retrieves the number of threads that execute a batch, including the calling thread.
+		 */
+		[[nodiscard]] std::size_t num_threads() const noexcept
+		{
+			return workers.size() + 1;
+		}
+
+		/**
+		 * @brief Invokes `callable(task_index)` for every index in [0, num_tasks), and blocks until all tasks are finished.
+		 *        The calling thread joins the work. Nested or concurrent batches run serially on the calling thread.
+		 * @details 并行执行任务，阻塞直到全部完成
+		 */
+		void parallel_for(std::size_t num_tasks, std::function<void(std::size_t)> const& callable);
+
+		/**
+		 * @brief Retrieves the thread pool shared by the engine.
+		 * @details 引擎共享的线程池
+		 */
+		static thread_pool& global();
+
+
+	private:
+		void worker_loop();
+
+		void run_tasks();
+
+
+	private:
+		/** Non-copyable. */
+		thread_pool(const thread_pool&) = delete;
+		thread_pool& operator = (const thread_pool&) = delete;
+	};
+}
\ No newline at end of file
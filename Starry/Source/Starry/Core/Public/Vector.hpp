@@ -130,6 +130,117 @@ namespace se
 
 
 
+namespace se
+{
+	struct vec3i
+	{
+		int32_t x, y, z;
+
+
+	public:
+		constexpr vec3i() noexcept : x(0), y(0), z(0) {}
+		constexpr vec3i(int32_t iv) noexcept : x(iv), y(iv), z(iv) {}
+		constexpr vec3i(int32_t ix, int32_t iy, int32_t iz) noexcept : x(ix), y(iy), z(iz) {}
+		constexpr vec3i& operator = (int32_t iv) noexcept { x = y = z = iv; return *this; }
+		constexpr vec3i(struct vec3 const&) noexcept;
+
+
+	public:
+		int32_t& operator [](int32_t index) noexcept { return (&x)[index]; }
+		int32_t const& operator [](int32_t index) const noexcept { return (&x)[index]; }
+		bool operator == (vec3i const& rhs) const noexcept { return x == rhs.x && y == rhs.y && z == rhs.z; }
+		bool operator != (vec3i const& rhs) const noexcept { return x != rhs.x || y != rhs.y || z != rhs.z; }
+
+
+	public:
+		vec3i operator - () const noexcept { return { -x, -y, -z }; }
+
+		vec3i operator + (vec3i const& rhs) const noexcept { return { x + rhs.x, y + rhs.y, z + rhs.z }; }
+		vec3i operator - (vec3i const& rhs) const noexcept { return { x - rhs.x, y - rhs.y, z - rhs.z }; }
+		vec3i operator * (vec3i const& rhs) const noexcept { return { x * rhs.x, y * rhs.y, z * rhs.z }; }
+		vec3i operator / (vec3i const& rhs) const noexcept { return { x / rhs.x, y / rhs.y, z / rhs.z }; }
+		vec3i const& operator += (vec3i const& rhs) noexcept { x += rhs.x; y += rhs.y; z += rhs.z; return *this; }
+		vec3i const& operator -= (vec3i const& rhs) noexcept { x -= rhs.x; y -= rhs.y; z -= rhs.z; return *this; }
+		vec3i const& operator *= (vec3i const& rhs) noexcept { x *= rhs.x; y *= rhs.y; z *= rhs.z; return *this; }
+		vec3i const& operator /= (vec3i const& rhs) noexcept { x /= rhs.x; y /= rhs.y; z /= rhs.z; return *this; }
+
+		vec3i operator + (int32_t rhs) const noexcept { return { x + rhs, y + rhs, z + rhs }; }
+		vec3i operator - (int32_t rhs) const noexcept { return { x - rhs, y - rhs, z - rhs }; }
+		vec3i operator * (int32_t rhs) const noexcept { return { x * rhs, y * rhs, z * rhs }; }
+		vec3i operator / (int32_t rhs) const noexcept { return { x / rhs, y / rhs, z / rhs }; }
+	};
+
+
+
+	/**
+	 * @brief Padded to the 16 bytes of a `float4`, so that it loads into one SIMD register with one aligned load.
+	 *        The padding lane `w` is kept zero.
+	 */
+	struct alignas(16) vec3
+	{
+		float x, y, z, w;
+
+
+	public:
+		constexpr vec3() noexcept : x(0), y(0), z(0), w(0) {}
+		constexpr vec3(float iv) noexcept : x(iv), y(iv), z(iv), w(0) {}
+		constexpr vec3(float ix, float iy, float iz) noexcept : x(ix), y(iy), z(iz), w(0) {}
+		constexpr vec3& operator = (float iv) noexcept { x = y = z = iv; return *this; }
+		constexpr vec3(struct vec3i const&) noexcept;
+
+
+	public:
+		float& operator [](int32_t index) noexcept { return (&x)[index]; }
+		float const& operator [](int32_t index) const noexcept { return (&x)[index]; }
+		bool operator == (vec3 const& rhs) const noexcept { return x == rhs.x && y == rhs.y && z == rhs.z; }
+		bool operator != (vec3 const& rhs) const noexcept { return x != rhs.x || y != rhs.y || z != rhs.z; }
+
+
+	public:
+		vec3 operator - () const noexcept { return { -x, -y, -z }; }
+
+		vec3 operator + (vec3 const& rhs) const noexcept { return { x + rhs.x, y + rhs.y, z + rhs.z }; }
+		vec3 operator - (vec3 const& rhs) const noexcept { return { x - rhs.x, y - rhs.y, z - rhs.z }; }
+		vec3 operator * (vec3 const& rhs) const noexcept { return { x * rhs.x, y * rhs.y, z * rhs.z }; }
+		vec3 operator / (vec3 const& rhs) const noexcept { return { x / rhs.x, y / rhs.y, z / rhs.z }; }
+		vec3 const& operator += (vec3 const& rhs) noexcept { x += rhs.x; y += rhs.y; z += rhs.z; return *this; }
+		vec3 const& operator -= (vec3 const& rhs) noexcept { x -= rhs.x; y -= rhs.y; z -= rhs.z; return *this; }
+		vec3 const& operator *= (vec3 const& rhs) noexcept { x *= rhs.x; y *= rhs.y; z *= rhs.z; return *this; }
+		vec3 const& operator /= (vec3 const& rhs) noexcept { x /= rhs.x; y /= rhs.y; z /= rhs.z; return *this; }
+
+		vec3 operator + (float rhs) const noexcept { return { x + rhs, y + rhs, z + rhs }; }
+		vec3 operator - (float rhs) const noexcept { return { x - rhs, y - rhs, z - rhs }; }
+		vec3 operator * (float rhs) const noexcept { return { x * rhs, y * rhs, z * rhs }; }
+		vec3 operator / (float rhs) const noexcept { return { x / rhs, y / rhs, z / rhs }; }
+		vec3 const& operator += (float rhs) noexcept { x += rhs; y += rhs; z += rhs; return *this; }
+		vec3 const& operator -= (float rhs) noexcept { x -= rhs; y -= rhs; z -= rhs; return *this; }
+		vec3 const& operator *= (float rhs) noexcept { x *= rhs; y *= rhs; z *= rhs; return *this; }
+		vec3 const& operator /= (float rhs) noexcept { x /= rhs; y /= rhs; z /= rhs; return *this; }
+
+
+	public:
+		float length_squared() const noexcept { return math::square(x) + math::square(y) + math::square(z); }
+		float distance_squared(vec3 const& v) const noexcept { return math::square(x - v.x) + math::square(y - v.y) + math::square(z - v.z); }
+	};
+
+
+
+	constexpr vec3i::vec3i(vec3 const& iv) noexcept
+		: x{ static_cast<int32_t>(iv.x) }
+		, y{ static_cast<int32_t>(iv.y) }
+		, z{ static_cast<int32_t>(iv.z) }
+	{}
+
+	constexpr vec3::vec3(vec3i const& iv) noexcept
+		: x{ static_cast<float>(iv.x) }
+		, y{ static_cast<float>(iv.y) }
+		, z{ static_cast<float>(iv.z) }
+		, w{ 0 }
+	{}
+}
+
+
+
 inline se::vec2i operator + (int32_t lhs, se::vec2i const& rhs) noexcept { return { lhs + rhs.x, lhs + rhs.y }; }
 inline se::vec2i operator - (int32_t lhs, se::vec2i const& rhs) noexcept { return { lhs - rhs.x, lhs - rhs.y }; }
 inline se::vec2i operator * (int32_t lhs, se::vec2i const& rhs) noexcept { return { lhs * rhs.x, lhs * rhs.y }; }
@@ -138,4 +249,14 @@ inline se::vec2i operator / (int32_t lhs, se::vec2i const& rhs) noexcept { retur
 inline se::vec2 operator + (float lhs, se::vec2 const& rhs) noexcept { return { lhs + rhs.x, lhs + rhs.y }; }
 inline se::vec2 operator - (float lhs, se::vec2 const& rhs) noexcept { return { lhs - rhs.x, lhs - rhs.y }; }
 inline se::vec2 operator * (float lhs, se::vec2 const& rhs) noexcept { return { lhs * rhs.x, lhs * rhs.y }; }
-inline se::vec2 operator / (float lhs, se::vec2 const& rhs) noexcept { return { lhs / rhs.x, lhs / rhs.y }; }
\ No newline at end of file
+inline se::vec2 operator / (float lhs, se::vec2 const& rhs) noexcept { return { lhs / rhs.x, lhs / rhs.y }; }
+
+inline se::vec3i operator + (int32_t lhs, se::vec3i const& rhs) noexcept { return { lhs + rhs.x, lhs + rhs.y, lhs + rhs.z }; }
+inline se::vec3i operator - (int32_t lhs, se::vec3i const& rhs) noexcept { return { lhs - rhs.x, lhs - rhs.y, lhs - rhs.z }; }
+inline se::vec3i operator * (int32_t lhs, se::vec3i const& rhs) noexcept { return { lhs * rhs.x, lhs * rhs.y, lhs * rhs.z }; }
+inline se::vec3i operator / (int32_t lhs, se::vec3i const& rhs) noexcept { return { lhs / rhs.x, lhs / rhs.y, lhs / rhs.z }; }
+
+inline se::vec3 operator + (float lhs, se::vec3 const& rhs) noexcept { return { lhs + rhs.x, lhs + rhs.y, lhs + rhs.z }; }
+inline se::vec3 operator - (float lhs, se::vec3 const& rhs) noexcept { return { lhs - rhs.x, lhs - rhs.y, lhs - rhs.z }; }
+inline se::vec3 operator * (float lhs, se::vec3 const& rhs) noexcept { return { lhs * rhs.x, lhs * rhs.y, lhs * rhs.z }; }
+inline se::vec3 operator / (float lhs, se::vec3 const& rhs) noexcept { return { lhs / rhs.x, lhs / rhs.y, lhs / rhs.z }; }
\ No newline at end of file
@@ -0,0 +1,105 @@
+﻿// Copyright (c) 2024 Fong ZiSing. All rights reserved.
+//
+//     Component.cpp
+//
+
+#include "Starry/Engine/Public/ECS/Component.hpp"
+
+#include <algorithm>
+#include <bit>
+
+#define STARRY_USE_INTRINSIC
+#ifdef STARRY_USE_INTRINSIC
+#include "Starry/Core/Private/Intrinsic.hpp"
+#endif
+
+
+namespace se::ecs
+{
+	/** Flags are read 16 at a time, one bit per entity. */
+	static constexpr std::size_t block_size = 16;
+
+
+
+	std::size_t plan_compaction(std::span<const uint8_t> dead, std::size_t num, std::vector<compaction_move>& moves)
+	{
+		moves.clear();
+		if (num == 0)
+		{
+			return 0;
+		}
+
+		// Entities past the end of the flags are live.
+		const uint8_t* dead_ptr = dead.data();
+		const std::size_t num_flags = std::min(dead.size(), num);
+		const auto dead_bits = [dead_ptr, num_flags](std::size_t base) -> uint32_t
+			{
+				const std::size_t count = base < num_flags ? std::min(block_size, num_flags - base) : 0;
+#ifdef STARRY_USE_INTRINSIC
+				if (count == block_size)
+				{
+					return (uint32_t)nonzero_byte_masks(load((const int*)(dead_ptr + base)));
+				}
+#endif
+				uint32_t bits = 0;
+				for (std::size_t lane = 0; lane < count; ++lane)
+				{
+					bits |= uint32_t(dead_ptr[base + lane] != 0) << lane;
+				}
+				return bits;
+			};
+
+		const auto live_bits = [&dead_bits, num](std::size_t base) -> uint32_t
+			{
+				const std::size_t count = std::min(block_size, num - base);
+				return ~dead_bits(base) & ((1u << count) - 1);
+			};
+
+		// Hoare partition: the front cursor walks the dead flags up, the back cursor walks the live flags down,
+		// each block of flags is read once by either of them. Everything below `front` is live, everything
+		// from `back` on is dead or moved.
+		std::size_t front_base = 0;
+		std::size_t back_base = (num - 1) / block_size * block_size;
+		uint32_t front_mask = dead_bits(front_base);
+		uint32_t back_mask = live_bits(back_base);
+		std::size_t back = num;
+
+		while (true)
+		{
+			while (front_mask == 0)
+			{
+				front_base += block_size;
+				if (front_base >= back)
+				{
+					return back;
+				}
+				front_mask = dead_bits(front_base);
+			}
+			const std::size_t front = front_base + std::countr_zero(front_mask);
+			if (front >= back)
+			{
+				return back;
+			}
+
+			while (back_mask == 0)
+			{
+				if (back_base <= front)
+				{
+					return front;
+				}
+				back_base -= block_size;
+				back_mask = live_bits(back_base);
+			}
+			const std::size_t last = back_base + std::bit_width(back_mask) - 1;
+			if (last < front)
+			{
+				return front;
+			}
+
+			moves.push_back(compaction_move{ (uint32_t)front, (uint32_t)last });
+			front_mask &= front_mask - 1;
+			back_mask &= ~(1u << (last - back_base));
+			back = last;
+		}
+	}
+}
\ No newline at end of file
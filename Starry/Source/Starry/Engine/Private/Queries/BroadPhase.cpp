@@ -0,0 +1,212 @@
+﻿// Copyright (c) 2024 Fong ZiSing. All rights reserved.
+//
+//     BroadPhase.cpp
+//
+
+#include "Starry/Engine/Public/Queries/BroadPhase.hpp"
+#include "Starry/Core/Public/ThreadPool.hpp"
+
+#include <cstring>
+#include <limits>
+
+
+namespace se
+{
+	void broad_phase2d::rebuild(std::span<const vec2> positions, std::span<const float> radii)
+	{
+		const std::size_t num = std::min(positions.size(), radii.size());
+		resources.resize(num);
+		slots.resize(num);
+
+		float min_radius = std::numeric_limits<float>::max();
+		float max_radius = 0.f;
+		for (std::size_t index = 0; index < num; ++index)
+		{
+			min_radius = std::min(min_radius, std::max(radii[index], 0.f));
+			max_radius = std::max(max_radius, radii[index]);
+		}
+
+		// The finest cell fits the smallest particle, unless it makes much more cells than particles.
+		const float area = float(std::max(bounds.x, 1)) * float(std::max(bounds.y, 1));
+		float base_cell_size = std::max({ 2.f * (num != 0 ? min_radius : 0.f), std::sqrt(area / float(2 * std::max<std::size_t>(num, 1))), 1e-3f });
+		int32_t num_levels = 1;
+		while (base_cell_size * float(1 << (num_levels - 1)) < 2.f * max_radius)
+		{
+			if (num_levels == max_levels)
+			{
+				// Too many levels, coarsens all of them so that the last one still fits the largest particle.
+				base_cell_size = 2.f * max_radius / float(1 << (max_levels - 1));
+				break;
+			}
+			++num_levels;
+		}
+
+		levels.clear();
+		int32_t num_cells = 0;
+		for (int32_t l = 0; l < num_levels; ++l)
+		{
+			const float cell_size = base_cell_size * float(1 << l);
+			const int32_t cols = cells_along(bounds.x, cell_size);
+			const int32_t rows = cells_along(bounds.y, cell_size);
+			levels.push_back(level{ cell_size, 1.f / cell_size, cols, rows, num_cells });
+			num_cells += cols * rows;
+		}
+		grids.assign(num_cells, grid{});
+
+		// Pass 1: the level of a particle is the finest one whose cells are as wide as its diameter.
+		const float inverse_base = 1.f / base_cell_size;
+		for (std::size_t index = 0; index < num; ++index)
+		{
+			const float diameter = 2.f * std::max(radii[index], 0.f);
+			int32_t l = std::clamp(int32_t(std::log2(std::max(diameter * inverse_base, 1.f))), 0, num_levels - 1);
+			while (l < num_levels - 1 && levels[l].cell_size < diameter)
+			{
+				++l;
+			}
+
+			const level& curr = levels[l];
+			const int32_t slot = curr.first_cell
+				+ cell_of(positions[index].y, curr.inverse_cell_size, curr.rows) * curr.cols
+				+ cell_of(positions[index].x, curr.inverse_cell_size, curr.cols);
+			slots[index] = slot;
+			grids[slot].num++;
+		}
+
+		// Pass 2: exclusive prefix sum, levels come one after another.
+		cursors.resize(grids.size());
+		int32_t offset = 0;
+		for (std::size_t cell = 0; cell < grids.size(); ++cell)
+		{
+			grids[cell].begin = offset;
+			cursors[cell] = offset;
+			offset += grids[cell].num;
+		}
+
+		// Pass 3: scatters, the particles of a cell keep their original order.
+		for (std::size_t index = 0; index < num; ++index)
+		{
+			resources[cursors[slots[index]]++] = resource{ positions[index], std::max(radii[index], 0.f), (int32_t)index };
+		}
+	}
+
+
+
+	void broad_phase2d::find_pairs_of(std::size_t first, std::size_t last, std::vector<contact_pair>& out) const
+	{
+		const resource* res_ptr = resources.data();
+		int32_t particle_level = 0;
+
+		for (std::size_t slot = first; slot < last; ++slot)
+		{
+			// Levels are sorted, so is the level of the slots.
+			while (particle_level + 1 < (int32_t)levels.size() && (int32_t)slot >= grids[levels[particle_level + 1].first_cell].begin)
+			{
+				++particle_level;
+			}
+
+			const resource& p = res_ptr[slot];
+			for (int32_t l = 0; l <= particle_level; ++l)
+			{
+				// Particles of the level are not larger than half of a cell, so are the particles overlapping `p`.
+				const level& curr = levels[l];
+				const float reach = p.radius + 0.5f * curr.cell_size;
+				const int32_t min_x = cell_of(p.position.x - reach, curr.inverse_cell_size, curr.cols);
+				const int32_t max_x = cell_of(p.position.x + reach, curr.inverse_cell_size, curr.cols);
+				const int32_t min_y = cell_of(p.position.y - reach, curr.inverse_cell_size, curr.rows);
+				const int32_t max_y = cell_of(p.position.y + reach, curr.inverse_cell_size, curr.rows);
+				const int32_t self_y = cell_of(p.position.y, curr.inverse_cell_size, curr.rows);
+
+				for (int32_t j = min_y; j <= max_y; ++j)
+				{
+					// On its own level, a pair is found from its lower slot only, and earlier rows hold lower slots.
+					if (l == particle_level && j < self_y)
+					{
+						continue;
+					}
+
+					const grid* row = grids.data() + curr.first_cell + (j * curr.cols);
+					int32_t begin = row[min_x].begin;
+					const int32_t end = row[max_x].begin + row[max_x].num;
+					if (l == particle_level && j == self_y)
+					{
+						begin = std::max(begin, (int32_t)slot + 1);
+					}
+
+					for (const resource* q = res_ptr + begin; q < res_ptr + end; ++q)
+					{
+						const float distance_squared = p.position.distance_squared(q->position);
+						if (distance_squared < math::square(p.radius + q->radius))
+						{
+							out.push_back(contact_pair{ std::min(p.index, q->index), std::max(p.index, q->index), distance_squared });
+						}
+					}
+				}
+			}
+		}
+	}
+
+
+
+	std::span<const contact_pair> broad_phase2d::find_pairs()
+	{
+		pairs.clear();
+		find_pairs_of(0, resources.size(), pairs);
+		return pairs;
+	}
+
+
+
+	std::span<const contact_pair> broad_phase2d::par_find_pairs()
+	{
+		thread_pool& pool = thread_pool::global();
+
+		// More chunks than threads, large particles at the end cost more than the others.
+		constexpr std::size_t min_chunk_size = 1024;
+		const std::size_t num_chunks = std::min(pool.num_threads() * 8, resources.size() / min_chunk_size);
+		if (num_chunks <= 1)
+		{
+			return find_pairs();
+		}
+
+		const std::size_t chunk_size = (resources.size() + num_chunks - 1) / num_chunks;
+		chunk_pairs.resize(num_chunks);
+		pool.parallel_for(num_chunks, [this, chunk_size](std::size_t chunk)
+			{
+				const std::size_t first = std::min(chunk * chunk_size, resources.size());
+				const std::size_t last = std::min(first + chunk_size, resources.size());
+				chunk_pairs[chunk].clear();
+				find_pairs_of(first, last, chunk_pairs[chunk]);
+			});
+
+		// Concatenates in chunk order, the pairs are the same and in the same order as `find_pairs()`.
+		std::size_t num_pairs = 0;
+		for (std::size_t chunk = 0; chunk < num_chunks; ++chunk)
+		{
+			num_pairs += chunk_pairs[chunk].size();
+		}
+		pairs.resize(num_pairs);
+
+		contact_pair* pair_ptr = pairs.data();
+		for (std::size_t chunk = 0; chunk < num_chunks; ++chunk)
+		{
+			if (!chunk_pairs[chunk].empty())
+			{
+				std::memcpy(pair_ptr, chunk_pairs[chunk].data(), chunk_pairs[chunk].size() * sizeof(contact_pair));
+			}
+			pair_ptr += chunk_pairs[chunk].size();
+		}
+		return pairs;
+	}
+
+
+
+	accelerator_stats broad_phase2d::stats() const noexcept
+	{
+		std::size_t memory_bytes = capacity_bytes_of(levels, grids, resources, slots, cursors, pairs, chunk_pairs);
+		for (std::vector<contact_pair> const& per_chunk : chunk_pairs)
+		{
+			memory_bytes += capacity_bytes_of(per_chunk);
+		}
+		return accelerator_stats{ resources.size(), grids.size(), memory_bytes };
+	}
+}
\ No newline at end of file
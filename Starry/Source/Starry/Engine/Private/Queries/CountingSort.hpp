@@ -0,0 +1,171 @@
+﻿// Copyright (c) 2024 Fong ZiSing. All rights reserved.
+//
+//     CountingSort.hpp
+//
+
+#pragma once
+
+#include "Starry/Core/Public/ThreadPool.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <span>
+
+
+
+// Counting sort of particles by the cell (slot) they fall in, shared by the uniform grids.
+// A cell is any struct with `begin` and `num` members, the dimension only changes how slots are computed.
+namespace se
+{
+	/**
+	 * @brief Retrieves the number of particles per chunk of a parallel rebuild, a multiple of 4,
+	 *        so that only the last chunk has a scalar remainder. 0 if a serial rebuild is cheaper.
+	 */
+	[[nodiscard]] inline std::size_t par_chunk_size_of(std::size_t num, std::size_t num_cells, std::size_t num_threads) noexcept
+	{
+		// Every chunk owns a private table of `num_cells` cells, only worth it while particles outnumber cells.
+		constexpr std::size_t min_chunk_size = 4096;
+		const std::size_t num_chunks = std::min(num_threads, num / min_chunk_size);
+		if (num_chunks <= 1 || num_cells > num)
+		{
+			return 0;
+		}
+		return ((num + num_chunks - 1) / num_chunks + 3) & ~std::size_t(3);
+	}
+
+
+
+	/**
+	 * @brief Clears the cells, then counts the particles of each cell from their slots.
+	 */
+	template <typename _grid_t>
+	void count_slots(std::span<_grid_t> grids, std::span<const int32_t> slots) noexcept
+	{
+		std::memset(grids.data(), 0, grids.size_bytes());
+		for (int32_t slot : slots)
+		{
+			grids[slot].num++;
+		}
+	}
+
+
+
+	/**
+	 * @brief Gives each cell its range from the counts in `num`, then invokes `scatter(position, index)` for every particle,
+	 *        `position` being where it goes in the sorted order. The particles of a cell keep their original order.
+	 * @param cursors Scratch, one cursor per cell.
+	 */
+	template <typename _grid_t, typename _scatter_t>
+	void counting_sort(std::span<_grid_t> grids, std::span<const int32_t> slots, std::vector<int32_t>& cursors, _scatter_t&& scatter) noexcept
+	{
+		// Exclusive prefix sum.
+		cursors.resize(grids.size());
+		int32_t* cursor = cursors.data();
+		int32_t offset = 0;
+		for (std::size_t cell = 0; cell < grids.size(); ++cell)
+		{
+			grids[cell].begin = offset;
+			cursor[cell] = offset;
+			offset += (int32_t)grids[cell].num;
+		}
+
+		const int32_t* slot_ptr = slots.data();
+		for (std::size_t index = 0; index < slots.size(); ++index)
+		{
+			[[msvc::forceinline_calls]]
+			scatter(cursor[slot_ptr[index]]++, index);
+		}
+	}
+
+
+
+	/**
+	 * @brief Same as `counting_sort()` on the engine thread pool, one chunk of `chunk_size` particles per task,
+	 *        the result is identical.
+	 * @param count_chunk Invoked as `count_chunk(first, count, histogram)`, computes the slots of the particles
+	 *                    in [first, first + count) and adds them to the zeroed `histogram` of the chunk.
+	 * @param histograms Scratch, one histogram per chunk.
+	 * @details 多线程计数排序：分块直方图、分段前缀和、无锁分发
+	 */
+	template <typename _grid_t, typename _count_t, typename _scatter_t>
+	void par_counting_sort(std::span<_grid_t> grids, std::span<const int32_t> slots, std::size_t chunk_size, std::vector<int32_t>& histograms, _count_t&& count_chunk, _scatter_t&& scatter)
+	{
+		thread_pool& pool = thread_pool::global();
+		const std::size_t num = slots.size();
+		const std::size_t num_chunks = (num + chunk_size - 1) / chunk_size;
+		const std::size_t num_cells = grids.size();
+		const std::size_t block_size = (num_cells + num_chunks - 1) / num_chunks;
+		histograms.resize(num_chunks * num_cells);
+		std::vector<int32_t> block_offsets(num_chunks + 1, 0);
+
+		_grid_t* grid_ptr = grids.data();
+		int32_t* histogram_ptr = histograms.data();
+		const int32_t* slot_ptr = slots.data();
+
+		// Pass 1: counts the particles of each cell per chunk.
+		pool.parallel_for(num_chunks, [&count_chunk, histogram_ptr, num, chunk_size, num_cells](std::size_t chunk)
+			{
+				const std::size_t first = chunk * chunk_size;
+				int32_t* histogram = histogram_ptr + chunk * num_cells;
+				std::memset(histogram, 0, num_cells * sizeof(int32_t));
+				count_chunk(first, std::min(chunk_size, num - first), histogram);
+			});
+
+		// Pass 2: sums each block of cells, then scans the block sums.
+		pool.parallel_for(num_chunks, [grid_ptr, histogram_ptr, num_chunks, num_cells, block_size, &block_offsets](std::size_t block)
+			{
+				const std::size_t first_cell = block * block_size;
+				const std::size_t last_cell = std::min(num_cells, first_cell + block_size);
+				int32_t block_sum = 0;
+				for (std::size_t cell = first_cell; cell < last_cell; ++cell)
+				{
+					int32_t cell_sum = 0;
+					for (std::size_t chunk = 0; chunk < num_chunks; ++chunk)
+					{
+						cell_sum += histogram_ptr[chunk * num_cells + cell];
+					}
+					grid_ptr[cell].num = cell_sum;
+					block_sum += cell_sum;
+				}
+				block_offsets[block + 1] = block_sum;
+			});
+
+		for (std::size_t block = 0; block < num_chunks; ++block)
+		{
+			block_offsets[block + 1] += block_offsets[block];
+		}
+
+		// Pass 3: turns the histograms into the scatter cursor of each (chunk, cell), in (cell, chunk) order.
+		pool.parallel_for(num_chunks, [grid_ptr, histogram_ptr, num_chunks, num_cells, block_size, &block_offsets](std::size_t block)
+			{
+				const std::size_t first_cell = block * block_size;
+				const std::size_t last_cell = std::min(num_cells, first_cell + block_size);
+				int32_t offset = block_offsets[block];
+				for (std::size_t cell = first_cell; cell < last_cell; ++cell)
+				{
+					grid_ptr[cell].begin = offset;
+					for (std::size_t chunk = 0; chunk < num_chunks; ++chunk)
+					{
+						int32_t& cursor = histogram_ptr[chunk * num_cells + cell];
+						int32_t count = cursor;
+						cursor = offset;
+						offset += count;
+					}
+				}
+			});
+
+		// Pass 4: scatters without locks, every (chunk, cell) writes to its own range.
+		pool.parallel_for(num_chunks, [&scatter, histogram_ptr, slot_ptr, num, chunk_size, num_cells](std::size_t chunk)
+			{
+				const std::size_t first = chunk * chunk_size;
+				const std::size_t last = std::min(first + chunk_size, num);
+				int32_t* cursor = histogram_ptr + chunk * num_cells;
+				for (std::size_t index = first; index < last; ++index)
+				{
+					[[msvc::forceinline_calls]]
+					scatter(cursor[slot_ptr[index]]++, index);
+				}
+			});
+	}
+}
\ No newline at end of file
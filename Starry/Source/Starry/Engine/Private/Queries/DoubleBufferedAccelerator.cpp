@@ -0,0 +1,110 @@
+﻿// Copyright (c) 2024 Fong ZiSing. All rights reserved.
+//
+//     DoubleBufferedAccelerator.cpp
+//
+
+#include "Starry/Engine/Public/Queries/DoubleBufferedAccelerator.hpp"
+
+
+
+namespace se
+{
+	double_buffered_accelerator::double_buffered_accelerator(const vec2i& scene_size, grid_layout in_layout, float in_cell_size)
+		: first(scene_size, in_layout, in_cell_size)
+		, second(scene_size, in_layout, in_cell_size)
+		, published(&first)
+	{
+		worker = std::thread(&double_buffered_accelerator::worker_loop, this);
+	}
+
+
+
+	double_buffered_accelerator::~double_buffered_accelerator()
+	{
+		{
+			std::lock_guard lock{ mutex };
+			stopping = true;
+		}
+		wake_condition.notify_all();
+		worker.join();
+	}
+
+
+
+	double_buffered_accelerator::read_guard double_buffered_accelerator::read() const noexcept
+	{
+		// Registers as a reader, then checks the buffer is still the published one,
+		// otherwise the worker may already have started rebuilding it.
+		while (true)
+		{
+			buffer* front = published.load();
+			front->readers.fetch_add(1);
+			if (published.load() == front)
+			{
+				return read_guard{ front };
+			}
+			front->readers.fetch_sub(1);
+		}
+	}
+
+
+
+	void double_buffered_accelerator::begin_rebuild(std::span<const vec2> positions)
+	{
+		std::unique_lock lock{ mutex };
+		done_condition.wait(lock, [this] { return !pending; });
+
+		snapshot.assign(positions.begin(), positions.end());
+		pending = true;
+		lock.unlock();
+		wake_condition.notify_one();
+	}
+
+
+
+	void double_buffered_accelerator::wait()
+	{
+		std::unique_lock lock{ mutex };
+		done_condition.wait(lock, [this] { return !pending; });
+	}
+
+
+
+	uint64_t double_buffered_accelerator::num_published()
+	{
+		std::lock_guard lock{ mutex };
+		return generation;
+	}
+
+
+
+	void double_buffered_accelerator::worker_loop()
+	{
+		std::unique_lock lock{ mutex };
+		while (true)
+		{
+			wake_condition.wait(lock, [this] { return pending || stopping; });
+			if (stopping)
+			{
+				return;
+			}
+			lock.unlock();
+
+			// The back buffer was published two rebuilds ago, waits for its last readers.
+			buffer* back = published.load() == &first ? &second : &first;
+			while (back->readers.load() != 0)
+			{
+				std::this_thread::yield();
+			}
+
+			// Each buffer keeps its own index, so the incremental update only relinks what moved since.
+			back->accel.update(snapshot);
+			published.store(back);
+
+			lock.lock();
+			pending = false;
+			++generation;
+			done_condition.notify_all();
+		}
+	}
+}
\ No newline at end of file
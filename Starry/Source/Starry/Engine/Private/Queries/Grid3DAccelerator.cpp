@@ -0,0 +1,206 @@
+﻿// Copyright (c) 2024 Fong ZiSing. All rights reserved.
+//
+//     Grid3DAccelerator.cpp
+//
+
+#include "Starry/Engine/Public/Queries/Grid3DAccelerator.hpp"
+#include "Starry/Engine/Private/Queries/CountingSort.hpp"
+
+#include <cstring>
+
+#define STARRY_USE_INTRINSIC
+#ifdef STARRY_USE_INTRINSIC
+#include "Starry/Core/Private/Intrinsic.hpp"
+#endif
+
+
+namespace se
+{
+	template <typename _callable_t>
+	void grid3d_accelerator::for_each_slot(std::span<const vec3> positions, _callable_t&& callable) const noexcept
+	{
+		const se::vec3* pos_ptr = positions.data();
+		std::size_t size = positions.size() / 4;
+		std::size_t index = 0;
+
+#ifndef STARRY_USE_INTRINSIC
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			for (std::size_t j = 0; j < 4; ++j)
+			{
+				[[msvc::forceinline_calls]] callable(slot_of(*pos_ptr++), index++);
+			}
+		}
+#else
+		const int4 min_0000 = zero4i();
+		const int4 max_xxxx = make(cols - 1);
+		const int4 max_yyyy = make(rows - 1);
+		const int4 max_zzzz = make(layers - 1);
+		const int4 row_stride = make(cols);
+		const int4 layer_stride = make(cols * rows);
+		const float4 scale = make(inverse_cell_size);
+
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			// Each `vec3` is one aligned `float4`, transposes four of them to xxxx, yyyy, zzzz.
+			float4 floating_pos1 = load_aligned(&pos_ptr[0].x);
+			float4 floating_pos2 = load_aligned(&pos_ptr[1].x);
+			float4 floating_pos3 = load_aligned(&pos_ptr[2].x);
+			float4 floating_pos4 = load_aligned(&pos_ptr[3].x);
+			float4 floating_xyxy1 = shuffle<0, 1, 0, 1>(floating_pos1, floating_pos2);
+			float4 floating_xyxy2 = shuffle<0, 1, 0, 1>(floating_pos3, floating_pos4);
+			float4 floating_zwzw1 = shuffle<2, 3, 2, 3>(floating_pos1, floating_pos2);
+			float4 floating_zwzw2 = shuffle<2, 3, 2, 3>(floating_pos3, floating_pos4);
+			float4 floating_xxxx = shuffle<0, 2, 0, 2>(floating_xyxy1, floating_xyxy2);
+			float4 floating_yyyy = shuffle<1, 3, 1, 3>(floating_xyxy1, floating_xyxy2);
+			float4 floating_zzzz = shuffle<0, 2, 0, 2>(floating_zwzw1, floating_zwzw2);
+
+			int4 clamped_xxxx = clamp(min_0000, max_xxxx, cast(mul(floating_xxxx, scale)));
+			int4 clamped_yyyy = clamp(min_0000, max_yyyy, cast(mul(floating_yyyy, scale)));
+			int4 clamped_zzzz = clamp(min_0000, max_zzzz, cast(mul(floating_zzzz, scale)));
+			int4 correct_slot = add(add(mul(layer_stride, clamped_zzzz), mul(row_stride, clamped_yyyy)), clamped_xxxx);
+
+			[[msvc::forceinline_calls]]
+			{
+				callable(extract<0>(correct_slot), index++);
+				callable(extract<1>(correct_slot), index++);
+				callable(extract<2>(correct_slot), index++);
+				callable(extract<3>(correct_slot), index++);
+			}
+			pos_ptr += 4;
+		}
+#endif
+		while (pos_ptr != positions.data() + positions.size())
+		{
+			[[msvc::forceinline_calls]]
+			callable(slot_of(*pos_ptr++), index++);
+		}
+	}
+
+
+
+	void grid3d_accelerator::rebuild(std::span<const se::vec3> positions) noexcept
+	{
+		resources.resize(positions.size());
+		slots.resize(positions.size());
+		std::memset(grids.data(), 0, grids.size() * sizeof(grid));
+
+		// Pass 1: counts the particles of each cell.
+		int32_t* slot_ptr = slots.data();
+		for_each_slot(positions, [this, slot_ptr](int32_t slot, std::size_t index)
+			{
+				slot_ptr[index] = slot;
+				grids[slot].num++;
+			});
+
+		sort_by_slots(positions);
+		indexed = true;
+	}
+
+
+
+	void grid3d_accelerator::sort_by_slots(std::span<const se::vec3> positions) noexcept
+	{
+		// Pass 2 and 3: prefix sum and scatter, the particles of a cell keep their original order.
+		const se::vec3* pos_ptr = positions.data();
+		resource* res_ptr = resources.data();
+		counting_sort(std::span<grid>(grids), slots, histograms, [pos_ptr, res_ptr](int32_t slot, std::size_t index)
+			{
+				const se::vec3& position = pos_ptr[index];
+				res_ptr[slot] = resource{ position.x, position.y, position.z, (int32_t)index };
+			});
+	}
+
+
+
+	void grid3d_accelerator::update(std::span<const se::vec3> positions) noexcept
+	{
+		if (!indexed || positions.size() != resources.size())
+		{
+			rebuild(positions);
+			return;
+		}
+
+		// Finds the particles that crossed a cell.
+		bool crossed = false;
+		int32_t* slot_ptr = slots.data();
+		for_each_slot(positions, [slot_ptr, &crossed](int32_t slot, std::size_t index)
+			{
+				crossed |= (slot != slot_ptr[index]);
+				slot_ptr[index] = slot;
+			});
+
+		if (!crossed)
+		{
+			// Same cells, same ranges, only refreshes the cached positions.
+			const se::vec3* pos_ptr = positions.data();
+			for (resource& res : resources)
+			{
+				const se::vec3& position = pos_ptr[res.index];
+				res.x = position.x;
+				res.y = position.y;
+				res.z = position.z;
+			}
+			return;
+		}
+
+		// Ranges have to move, resorts with the slots computed above.
+		count_slots(std::span<grid>(grids), slots);
+		sort_by_slots(positions);
+	}
+
+
+
+	void grid3d_accelerator::par_rebuild(std::span<const se::vec3> positions)
+	{
+		const std::size_t chunk_size = par_chunk_size_of(positions.size(), grids.size(), thread_pool::global().num_threads());
+		if (chunk_size == 0)
+		{
+			rebuild(positions);
+			return;
+		}
+
+		resources.resize(positions.size());
+		slots.resize(positions.size());
+
+		const se::vec3* pos_ptr = positions.data();
+		resource* res_ptr = resources.data();
+		int32_t* slot_ptr = slots.data();
+		par_counting_sort(std::span<grid>(grids), slots, chunk_size, histograms,
+			[this, positions, slot_ptr](std::size_t first, std::size_t count, int32_t* histogram)
+			{
+				int32_t* chunk_slots = slot_ptr + first;
+				for_each_slot(positions.subspan(first, count), [chunk_slots, histogram](int32_t slot, std::size_t index)
+					{
+						chunk_slots[index] = slot;
+						histogram[slot]++;
+					});
+			},
+			[pos_ptr, res_ptr](int32_t slot, std::size_t index)
+			{
+				const se::vec3& position = pos_ptr[index];
+				res_ptr[slot] = resource{ position.x, position.y, position.z, (int32_t)index };
+			});
+
+		indexed = true;
+	}
+
+
+
+	void grid3d_accelerator::query_near_of(std::size_t index, vec3 position, float radius, std::function<void(int, float, vec3 const)>&& callable) const
+	{
+		query_near_of<std::function<void(int, float, vec3 const)>&>(index, position, radius, callable);
+	}
+
+
+
+	accelerator_stats grid3d_accelerator::stats() const noexcept
+	{
+		return accelerator_stats
+		{
+			resources.size(),
+			grids.size(),
+			capacity_bytes_of(grids, resources, slots, histograms),
+		};
+	}
+}
\ No newline at end of file
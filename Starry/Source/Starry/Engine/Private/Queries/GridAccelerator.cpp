@@ -4,6 +4,10 @@
 //
 
 #include "Starry/Engine/Public/Queries/GridAccelerator.hpp"
+#include "Starry/Engine/Private/Queries/CountingSort.hpp"
+
+#include <cstring>
+#include <bit>
 
 #define STARRY_USE_INTRINSIC
 #ifdef STARRY_USE_INTRINSIC
@@ -13,39 +17,31 @@
 
 namespace se
 {
-	void grid2d_accelerator::rebuild(std::span<const se::vec2> positions) noexcept
+#ifdef STARRY_USE_INTRINSIC
+	/** Vector version of `grid2d_accelerator::wrap_of()` for one coordinate of four positions. */
+	[[msvc::forceinline]] static float4 wrap_lanes(float4 const& xmm, float4 const& period, float4 const& inverse_period) noexcept
 	{
-		resources.resize(positions.size());
-		std::memset(grids.data(), 0, grids.size() * sizeof(grid));
+		float4 wrapped = nmul_add(period, floor(mul(xmm, inverse_period)), xmm);
+		wrapped = sub(wrapped, bit_and(ge(wrapped, period), period));
+		return add(wrapped, bit_and(lt(wrapped, zero4f()), period));
+	}
+#endif
 
-		const se::vec2* pos_ptr = positions.data();
-		resource* res_ptr = resources.data();
-		std::size_t size = positions.size() / 4;
 
-		const auto insert_lambda = [this, res_ptr](int32_t slot, resource* last, const vec2* position)
-			{
-				grid& curr = grids[slot];
-				int32_t prev = curr.head;
-				last->position = *position;
-				last->next = prev;
-				curr.head = (int32_t)std::distance(res_ptr, last) + 1;
-				curr.num++;
-			};
 
+	template <typename _callable_t>
+	void grid2d_accelerator::for_each_slot(std::span<const vec2> positions, _callable_t&& callable) const noexcept
+	{
+		const se::vec2* pos_ptr = positions.data();
+		std::size_t size = positions.size() / 4;
+		std::size_t index = 0;
 
 #ifndef STARRY_USE_INTRINSIC
 		for (std::size_t i = 0; i < size; ++i)
 		{
 			for (std::size_t j = 0; j < 4; ++j)
 			{
-				vec2 const& position = *pos_ptr;
-				int32_t integer_x = int32_t(position.x) >> grid_bits;
-				int32_t integer_y = int32_t(position.y) >> grid_bits;
-				int32_t clamped_x = std::clamp(integer_x, 0, cols - 1);
-				int32_t clamped_y = std::clamp(integer_y, 0, rows - 1);
-				int32_t slot = clamped_x + (clamped_y * cols);
-
-				[[msvc::forceinline_calls]] insert_lambda(slot, res_ptr++, pos_ptr++);
+				[[msvc::forceinline_calls]] callable(slot_of(*pos_ptr++), index++);
 			}
 		}
 #else
@@ -53,6 +49,12 @@ namespace se
 		const int4 max_xxxx = make(cols - 1);
 		const int4 max_yyyy = make(rows - 1);
 		const int4 stride = make(cols);
+		const float4 scale = make(inverse_cell_size);
+		const bool periodic = boundary == grid_boundary::periodic;
+		const float4 period_xxxx = make(period.x);
+		const float4 period_yyyy = make(period.y);
+		const float4 inverse_xxxx = make(inverse_period.x);
+		const float4 inverse_yyyy = make(inverse_period.y);
 
 		for (std::size_t i = 0; i < size; ++i)
 		{
@@ -60,80 +62,800 @@ namespace se
 			float4 floating_pos2 = load((const float*)(pos_ptr + 2));
 			float4 floating_xxxx = shuffle<0, 2, 0, 2>(floating_pos1, floating_pos2);
 			float4 floating_yyyy = shuffle<1, 3, 1, 3>(floating_pos1, floating_pos2);
+			if (periodic)
+			{
+				floating_xxxx = wrap_lanes(floating_xxxx, period_xxxx, inverse_xxxx);
+				floating_yyyy = wrap_lanes(floating_yyyy, period_yyyy, inverse_yyyy);
+			}
 
-			int4 shifted_xxxx = bit_ashift(cast(floating_xxxx), grid_bits);
-			int4 shifted_yyyy = bit_ashift(cast(floating_yyyy), grid_bits);
-			int4 clamped_xxxx = clamp(min_0000, max_xxxx, shifted_xxxx);
-			int4 clamped_yyyy = clamp(min_0000, max_yyyy, shifted_yyyy);
+			int4 scaled_xxxx = cast(mul(floating_xxxx, scale));
+			int4 scaled_yyyy = cast(mul(floating_yyyy, scale));
+			int4 clamped_xxxx = clamp(min_0000, max_xxxx, scaled_xxxx);
+			int4 clamped_yyyy = clamp(min_0000, max_yyyy, scaled_yyyy);
 			int4 correct_slot = add(mul(stride, clamped_yyyy), clamped_xxxx);
 
 			[[msvc::forceinline_calls]]
 			{
-				insert_lambda(extract<0>(correct_slot), res_ptr++, pos_ptr++);
-				insert_lambda(extract<1>(correct_slot), res_ptr++, pos_ptr++);
-				insert_lambda(extract<2>(correct_slot), res_ptr++, pos_ptr++);
-				insert_lambda(extract<3>(correct_slot), res_ptr++, pos_ptr++);
+				callable(extract<0>(correct_slot), index++);
+				callable(extract<1>(correct_slot), index++);
+				callable(extract<2>(correct_slot), index++);
+				callable(extract<3>(correct_slot), index++);
 			}
+			pos_ptr += 4;
 		}
 #endif
 		while (pos_ptr != positions.data() + positions.size())
 		{
-			vec2 const& position = *pos_ptr;
-			int32_t integer_x = int32_t(position.x) >> grid_bits;
-			int32_t integer_y = int32_t(position.y) >> grid_bits;
-			int32_t clamped_x = std::clamp(integer_x, 0, cols - 1);
-			int32_t clamped_y = std::clamp(integer_y, 0, rows - 1);
-			int32_t slot = clamped_x + (clamped_y * cols);
-
 			[[msvc::forceinline_calls]]
-			insert_lambda(slot, res_ptr++, pos_ptr++);
+			callable(slot_of(*pos_ptr++), index++);
+		}
+	}
+
+
+
+	void grid2d_accelerator::rebuild(std::span<const se::vec2> positions) noexcept
+	{
+		resize_storage(positions.size());
+		std::memset(grids.data(), 0, grids.size() * sizeof(grid));
+
+		if (layout != grid_layout::linked_list)
+		{
+			rebuild_counting_sort(positions);
+		}
+		else
+		{
+			rebuild_linked_list(positions);
+		}
+		indexed = true;
+	}
+
+
+
+	void grid2d_accelerator::update(std::span<const se::vec2> positions) noexcept
+	{
+		if (!indexed || positions.size() != slots.size())
+		{
+			rebuild(positions);
+			return;
+		}
+
+		if (layout != grid_layout::linked_list)
+		{
+			update_counting_sort(positions);
+		}
+		else
+		{
+			update_linked_list(positions);
+		}
+	}
+
+
+
+	void grid2d_accelerator::resize_storage(std::size_t num) noexcept
+	{
+		slots.resize(num);
+		if (layout == grid_layout::sorted_arrays)
+		{
+			resources.clear();
+			sorted_xs.resize(num + sorted_padding);
+			sorted_ys.resize(num + sorted_padding);
+			sorted_indices.resize(num);
+		}
+		else
+		{
+			resources.resize(num);
+			sorted_xs.clear();
+			sorted_ys.clear();
+			sorted_indices.clear();
+		}
+	}
+
+
+
+	void grid2d_accelerator::rebuild_linked_list(std::span<const se::vec2> positions) noexcept
+	{
+		const se::vec2* pos_ptr = positions.data();
+		resource* res_ptr = resources.data();
+		int32_t* slot_ptr = slots.data();
+
+		for_each_slot(positions, [this, pos_ptr, res_ptr, slot_ptr](int32_t slot, std::size_t index)
+			{
+				grid& curr = grids[slot];
+				slot_ptr[index] = slot;
+				resource& last = res_ptr[index];
+				last.position = pos_ptr[index];
+				last.next = curr.head;
+				last.index = (int32_t)index;
+				curr.head = (int32_t)index + 1;
+				curr.num++;
+			});
+	}
+
+
+
+	void grid2d_accelerator::rebuild_counting_sort(std::span<const se::vec2> positions) noexcept
+	{
+		// Pass 1: counts the particles of each cell.
+		int32_t* slot_ptr = slots.data();
+		for_each_slot(positions, [this, slot_ptr](int32_t slot, std::size_t index)
+			{
+				slot_ptr[index] = slot;
+				grids[slot].num++;
+			});
+
+		sort_by_slots(positions);
+	}
+
+
+
+	template <typename _callable_t>
+	void grid2d_accelerator::with_scatter_of(std::span<const vec2> positions, _callable_t&& callable)
+	{
+		const se::vec2* pos_ptr = positions.data();
+		if (layout == grid_layout::sorted_arrays)
+		{
+			float* xs = sorted_xs.data();
+			float* ys = sorted_ys.data();
+			int32_t* indices = sorted_indices.data();
+			callable([pos_ptr, xs, ys, indices](int32_t slot, std::size_t index)
+				{
+					xs[slot] = pos_ptr[index].x;
+					ys[slot] = pos_ptr[index].y;
+					indices[slot] = (int32_t)index;
+				});
+			return;
+		}
+
+		resource* res_ptr = resources.data();
+		callable([pos_ptr, res_ptr](int32_t slot, std::size_t index)
+			{
+				resource& res = res_ptr[slot];
+				res.position = pos_ptr[index];
+				res.next = 0;
+				res.index = (int32_t)index;
+			});
+	}
+
+
+
+	void grid2d_accelerator::sort_by_slots(std::span<const se::vec2> positions) noexcept
+	{
+		// Pass 2 and 3: prefix sum and scatter, the particles of a cell keep their original order.
+		with_scatter_of(positions, [this](auto const& scatter)
+			{
+				counting_sort(std::span<grid>(grids), slots, histograms, scatter);
+			});
+	}
+
+
+
+	void grid2d_accelerator::update_linked_list(std::span<const se::vec2> positions) noexcept
+	{
+		const se::vec2* pos_ptr = positions.data();
+		resource* res_ptr = resources.data();
+		const int32_t* slot_ptr = slots.data();
+
+		// Refreshes the cached positions in place and collects the particles that crossed a cell.
+		movers.clear();
+		for_each_slot(positions, [this, pos_ptr, res_ptr, slot_ptr](int32_t slot, std::size_t index)
+			{
+				res_ptr[index].position = pos_ptr[index];
+				if (slot != slot_ptr[index])
+				{
+					movers.push_back((int32_t)index);
+				}
+			});
+
+		// Relinks the movers only, a cell holds a handful of particles so unlinking is cheap.
+		for (int32_t index : movers)
+		{
+			resource& res = res_ptr[index];
+			grid& from = grids[slots[index]];
+			if (from.head == index + 1)
+			{
+				from.head = res.next;
+			}
+			else
+			{
+				int32_t prev = from.head;
+				while (res_ptr[prev - 1].next != index + 1)
+				{
+					prev = res_ptr[prev - 1].next;
+				}
+				res_ptr[prev - 1].next = res.next;
+			}
+			from.num--;
+
+			const int32_t slot = slot_of(res.position);
+			grid& to = grids[slot];
+			res.next = to.head;
+			to.head = index + 1;
+			to.num++;
+			slots[index] = slot;
+		}
+	}
+
+
+
+	void grid2d_accelerator::update_counting_sort(std::span<const se::vec2> positions) noexcept
+	{
+		// Finds the particles that crossed a cell.
+		bool crossed = false;
+		int32_t* slot_ptr = slots.data();
+		for_each_slot(positions, [slot_ptr, &crossed](int32_t slot, std::size_t index)
+			{
+				crossed |= (slot != slot_ptr[index]);
+				slot_ptr[index] = slot;
+			});
+
+		if (!crossed)
+		{
+			// Same cells, same ranges, only refreshes the cached positions.
+			const se::vec2* pos_ptr = positions.data();
+			if (layout == grid_layout::sorted_arrays)
+			{
+				for (std::size_t slot = 0; slot < sorted_indices.size(); ++slot)
+				{
+					sorted_xs[slot] = pos_ptr[sorted_indices[slot]].x;
+					sorted_ys[slot] = pos_ptr[sorted_indices[slot]].y;
+				}
+			}
+			else
+			{
+				for (resource& res : resources)
+				{
+					res.position = pos_ptr[res.index];
+				}
+			}
+			return;
+		}
+
+		// Ranges have to move, resorts with the slots computed above.
+		count_slots(std::span<grid>(grids), slots);
+		sort_by_slots(positions);
+	}
+
+
+
+	void grid2d_accelerator::par_rebuild(std::span<const se::vec2> positions)
+	{
+		const std::size_t chunk_size = par_chunk_size_of(positions.size(), grids.size(), thread_pool::global().num_threads());
+		if (chunk_size == 0)
+		{
+			rebuild(positions);
+			return;
+		}
+
+		resize_storage(positions.size());
+
+		if (layout != grid_layout::linked_list)
+		{
+			par_rebuild_counting_sort(positions, chunk_size);
+		}
+		else
+		{
+			par_rebuild_linked_list(positions, (positions.size() + chunk_size - 1) / chunk_size, chunk_size);
 		}
+		indexed = true;
+	}
+
+
+
+	void grid2d_accelerator::par_rebuild_linked_list(std::span<const se::vec2> positions, std::size_t num_chunks, std::size_t chunk_size)
+	{
+		thread_pool& pool = thread_pool::global();
+		const std::size_t num_cells = grids.size();
+		const std::size_t block_size = (num_cells + num_chunks - 1) / num_chunks;
+		histograms.resize(num_chunks * num_cells);
+		chain_ends.resize(num_chunks * num_cells * 2);
+
+		// Pass 1: links the particles of each chunk, remembers the first and the last one of each cell.
+		pool.parallel_for(num_chunks, [this, positions, chunk_size, num_cells](std::size_t chunk)
+			{
+				const std::size_t first = chunk * chunk_size;
+				const std::size_t count = std::min(chunk_size, positions.size() - first);
+				int32_t* histogram = histograms.data() + chunk * num_cells;
+				int32_t* chain_first = chain_ends.data() + chunk * num_cells * 2;
+				int32_t* chain_last = chain_first + num_cells;
+				std::memset(histogram, 0, num_cells * sizeof(int32_t));
+				std::memset(chain_first, 0, num_cells * 2 * sizeof(int32_t));
+
+				const se::vec2* pos_ptr = positions.data() + first;
+				resource* res_ptr = resources.data() + first;
+				int32_t* slot_ptr = slots.data() + first;
+				for_each_slot(positions.subspan(first, count), [=](int32_t slot, std::size_t index)
+					{
+						resource& last = res_ptr[index];
+						slot_ptr[index] = slot;
+						const int32_t global_index = int32_t(first + index);
+						last.position = pos_ptr[index];
+						last.next = chain_last[slot];
+						last.index = global_index;
+						chain_first[slot] = chain_last[slot] ? chain_first[slot] : global_index + 1;
+						chain_last[slot] = global_index + 1;
+						histogram[slot]++;
+					});
+			});
+
+		// Pass 2: stitches the chains of each cell in chunk order.
+		pool.parallel_for(num_chunks, [this, num_chunks, num_cells, block_size](std::size_t block)
+			{
+				const std::size_t first_cell = block * block_size;
+				const std::size_t last_cell = std::min(num_cells, first_cell + block_size);
+				for (std::size_t cell = first_cell; cell < last_cell; ++cell)
+				{
+					grid& curr = grids[cell];
+					curr.num = 0;
+					curr.head = 0;
+					curr.begin = 0;
+
+					for (std::size_t chunk = 0; chunk < num_chunks; ++chunk)
+					{
+						const int32_t* chain_first = chain_ends.data() + chunk * num_cells * 2;
+						const int32_t* chain_last = chain_first + num_cells;
+						if (chain_last[cell])
+						{
+							resources[chain_first[cell] - 1].next = curr.head;
+							curr.head = chain_last[cell];
+							curr.num += histograms[chunk * num_cells + cell];
+						}
+					}
+				}
+			});
+	}
+
+
+
+	void grid2d_accelerator::par_rebuild_counting_sort(std::span<const se::vec2> positions, std::size_t chunk_size)
+	{
+		int32_t* slot_ptr = slots.data();
+		const auto count_chunk = [this, positions, slot_ptr](std::size_t first, std::size_t count, int32_t* histogram)
+			{
+				int32_t* chunk_slots = slot_ptr + first;
+				for_each_slot(positions.subspan(first, count), [chunk_slots, histogram](int32_t slot, std::size_t index)
+					{
+						chunk_slots[index] = slot;
+						histogram[slot]++;
+					});
+			};
+
+		with_scatter_of(positions, [this, chunk_size, &count_chunk](auto const& scatter)
+			{
+				par_counting_sort(std::span<grid>(grids), slots, chunk_size, histograms, count_chunk, scatter);
+			});
 	}
 
 
 
 	void grid2d_accelerator::query_near_of(std::size_t index, vec2 position, float radius, std::function<void(int, float, vec2 const)>&& callable) const
+	{
+		query_near_of<std::function<void(int, float, vec2 const)>&>(index, position, radius, callable);
+	}
+
+
+
+	accelerator_stats grid2d_accelerator::stats() const noexcept
+	{
+		return accelerator_stats
+		{
+			slots.size(),
+			grids.size(),
+			capacity_bytes_of(grids, resources, sorted_xs, sorted_ys, sorted_indices, slots, movers, histograms, chain_ends),
+		};
+	}
+
+
+
+	void grid2d_accelerator::wrap(std::span<vec2> positions) const noexcept
+	{
+		vec2* pos_ptr = positions.data();
+		vec2* const end_ptr = pos_ptr + positions.size();
+
+#ifdef STARRY_USE_INTRINSIC
+		const float4 period_xyxy = make(period.x, period.y, period.x, period.y);
+		const float4 inverse_xyxy = make(inverse_period.x, inverse_period.y, inverse_period.x, inverse_period.y);
+		for (; end_ptr - pos_ptr >= 2; pos_ptr += 2)
+		{
+			float4 xyxy = load((const float*)pos_ptr);
+			store(wrap_lanes(xyxy, period_xyxy, inverse_xyxy), (float*)pos_ptr);
+		}
+#endif
+		for (; pos_ptr != end_ptr; ++pos_ptr)
+		{
+			*pos_ptr = wrap_of(*pos_ptr);
+		}
+	}
+
+
+
+	std::size_t grid2d_accelerator::filter_sorted(int32_t first, int32_t last, vec2 position, float radius_squared, int32_t* hit_slots, float* hit_distances) const noexcept
+	{
+		const float* xs = sorted_xs.data();
+		const float* ys = sorted_ys.data();
+		std::size_t num_hits = 0;
+
+#ifdef STARRY_USE_INTRINSIC
+		const float4 probe_xxxx = make(position.x);
+		const float4 probe_yyyy = make(position.y);
+		const float4 radius_squared4 = make(radius_squared);
+		alignas(16) float distances[4];
+
+		// The arrays are padded, the lanes past `last` are loaded and masked out.
+		for (int32_t slot = first; slot < last; slot += 4)
+		{
+			float4 delta_xxxx = sub(load(xs + slot), probe_xxxx);
+			float4 delta_yyyy = sub(load(ys + slot), probe_yyyy);
+			float4 distance_squared = mul_add(delta_xxxx, delta_xxxx, mul(delta_yyyy, delta_yyyy));
+
+			int mask = sign_masks(lt(distance_squared, radius_squared4)) & ((1 << std::min(last - slot, 4)) - 1);
+			if (mask == 0)
+			{
+				continue;
+			}
+
+			store_aligned(distance_squared, distances);
+			while (mask)
+			{
+				const int lane = std::countr_zero((unsigned)mask);
+				hit_slots[num_hits] = slot + lane;
+				hit_distances[num_hits++] = distances[lane];
+				mask &= mask - 1;
+			}
+		}
+#else
+		for (int32_t slot = first; slot < last; ++slot)
+		{
+			if (float distance_squared = math::square(xs[slot] - position.x) + math::square(ys[slot] - position.y); distance_squared < radius_squared)
+			{
+				hit_slots[num_hits] = slot;
+				hit_distances[num_hits++] = distance_squared;
+			}
+		}
+#endif
+		return num_hits;
+	}
+
+
+
+	void grid2d_accelerator::query_near_of_batch(std::span<const vec2> probes, float radius, std::function<void(std::span<const probe_hit>)> const& callable) const
 	{
 		if (radius <= 0) [[unlikely]]
 		{
 			return;
 		}
 
-		// TODO
-
+		constexpr std::size_t block_size = 256;
+		probe_hit block[block_size];
+		std::size_t num_hits = 0;
 		const float radius_squared = math::square(radius);
-		const int32_t integer_radius = (int32_t)radius;
-		const int32_t grid_radius = (integer_radius + (1 << grid_bits) - 1) >> grid_bits;
 
-		int32_t slot_x = int32_t(position.x) >> grid_bits;
-		int32_t slot_y = int32_t(position.y) >> grid_bits;
+		const auto flush = [&]()
+			{
+				if (num_hits != 0)
+				{
+					callable(std::span<const probe_hit>(block, num_hits));
+					num_hits = 0;
+				}
+			};
+
+		const auto emit = [&](int32_t probe, int32_t index, float distance_squared)
+			{
+				block[num_hits++] = probe_hit{ probe, index, distance_squared };
+				if (num_hits == block_size)
+				{
+					flush();
+				}
+			};
+
+		for (std::size_t probe = 0; probe < probes.size(); ++probe)
+		{
+			const vec2 position = probes[probe];
+			if (boundary == grid_boundary::periodic)
+			{
+				// Probes are not particles, nothing to skip.
+				query_near_of_periodic(std::size_t(-1), position, radius, [&](int index, float distance_squared, vec2 const)
+					{
+						emit((int32_t)probe, index, distance_squared);
+					});
+				continue;
+			}
+
+			const cell_box box = cells_within(position, radius);
+			if (box.min_x >= box.max_x || box.min_y >= box.max_y)
+			{
+				continue;
+			}
+
+			if (layout == grid_layout::sorted_arrays)
+			{
+				int32_t hit_slots[sorted_block_size];
+				float hit_distances[sorted_block_size];
+				for (int32_t j = box.min_y; j < box.max_y; ++j)
+				{
+					const grid* row = grids.data() + (j * cols);
+					const int32_t last = row[box.max_x - 1].begin + (int32_t)row[box.max_x - 1].num;
+					for (int32_t first = row[box.min_x].begin; first < last; first += sorted_block_size)
+					{
+						const std::size_t num_hits = filter_sorted(first, std::min(first + sorted_block_size, last), position, radius_squared, hit_slots, hit_distances);
+						for (std::size_t hit = 0; hit < num_hits; ++hit)
+						{
+							emit((int32_t)probe, sorted_indices[hit_slots[hit]], hit_distances[hit]);
+						}
+					}
+				}
+				continue;
+			}
+
+#ifdef STARRY_USE_INTRINSIC
+			const float4 probe_xxxx = make(position.x);
+			const float4 probe_yyyy = make(position.y);
+			const float4 radius_squared4 = make(radius_squared);
+
+			// Tests four resources at once, each resource is one aligned `float4` of (x, y, next, index).
+			const auto test4 = [&](const resource* const (&candidates)[4], int valid_mask)
+				{
+					float4 xyxy1 = shuffle<0, 1, 0, 1>(load_aligned(&candidates[0]->position.x), load_aligned(&candidates[1]->position.x));
+					float4 xyxy2 = shuffle<0, 1, 0, 1>(load_aligned(&candidates[2]->position.x), load_aligned(&candidates[3]->position.x));
+					float4 delta_xxxx = sub(shuffle<0, 2, 0, 2>(xyxy1, xyxy2), probe_xxxx);
+					float4 delta_yyyy = sub(shuffle<1, 3, 1, 3>(xyxy1, xyxy2), probe_yyyy);
+					float4 distance_squared = mul_add(delta_xxxx, delta_xxxx, mul(delta_yyyy, delta_yyyy));
+
+					int mask = sign_masks(lt(distance_squared, radius_squared4)) & valid_mask;
+					if (mask == 0)
+					{
+						return;
+					}
+
+					alignas(16) float distances[4];
+					store_aligned(distance_squared, distances);
+					while (mask)
+					{
+						const int lane = std::countr_zero((unsigned)mask);
+						emit((int32_t)probe, candidates[lane]->index, distances[lane]);
+						mask &= mask - 1;
+					}
+				};
+
+			if (layout == grid_layout::counting_sort)
+			{
+				for (int32_t j = box.min_y; j < box.max_y; ++j)
+				{
+					const grid* row = grids.data() + (j * cols);
+					const resource* first = resources.data() + row[box.min_x].begin;
+					const resource* last = resources.data() + row[box.max_x - 1].begin + row[box.max_x - 1].num;
+
+					for (; last - first >= 4; first += 4)
+					{
+						test4({ first, first + 1, first + 2, first + 3 }, 0xf);
+					}
+					if (const int remain = int(last - first); remain > 0)
+					{
+						test4({ first, first + std::min(1, remain - 1), first + std::min(2, remain - 1), first }, (1 << remain) - 1);
+					}
+				}
+			}
+			else
+			{
+				// Stages the chained resources four by four.
+				const resource* staged[4];
+				int num_staged = 0;
+				for (int32_t j = box.min_y; j < box.max_y; ++j)
+				{
+					for (int32_t i = box.min_x; i < box.max_x; ++i)
+					{
+						for (int32_t head = grids[i + (j * cols)].head; head; head = resources[head - 1].next)
+						{
+							staged[num_staged++] = &resources[head - 1];
+							if (num_staged == 4)
+							{
+								test4(staged, 0xf);
+								num_staged = 0;
+							}
+						}
+					}
+				}
+				if (num_staged > 0)
+				{
+					for (int lane = num_staged; lane < 4; ++lane)
+					{
+						staged[lane] = staged[0];
+					}
+					test4(staged, (1 << num_staged) - 1);
+				}
+			}
+#else
+			for (int32_t j = box.min_y; j < box.max_y; ++j)
+			{
+				for (int32_t i = box.min_x; i < box.max_x; ++i)
+				{
+					for_each_in_cell(grids[i + (j * cols)], [&](resource const& res)
+						{
+							if (float distance_squared = position.distance_squared(res.position); distance_squared < radius_squared)
+							{
+								emit((int32_t)probe, res.index, distance_squared);
+							}
+						});
+				}
+			}
+#endif
+		}
+
+		flush();
+	}
+
 
-		int4 box = make(-grid_radius, -grid_radius, grid_radius, grid_radius);
-		box = add(box, make(slot_x, slot_y, slot_x, slot_y));
-		box = clamp(zero4i(), make(cols, rows, cols, rows), box);
-		
-		for (int32_t i = box.m128i_i32[0]; i < box.m128i_i32[2]; ++i)
+
+	std::size_t grid2d_accelerator::query_k_nearest(std::size_t index, vec2 position, std::size_t k, std::span<nearest_neighbor> out) const noexcept
+	{
+		k = std::min(k, out.size());
+		if (k == 0 || slots.empty()) [[unlikely]]
 		{
-			for (int32_t j = box.m128i_i32[1]; j < box.m128i_i32[3]; ++j)
+			return 0;
+		}
+
+		// Max-heap on distance, the root is the k-th nearest found so far.
+		nearest_neighbor* heap = out.data();
+		std::size_t count = 0;
+		const auto heap_less = [](nearest_neighbor const& lhs, nearest_neighbor const& rhs)
 			{
-				int32_t slot = i + (j * cols);
-				const grid& grid = grids[slot];
-				int32_t head = grid.head;
-				
-				while (head)
+				return lhs.distance_squared < rhs.distance_squared;
+			};
+		const auto visit = [&](resource const& res)
+			{
+				if (index == (std::size_t)res.index) // ignore self.
+				{
+					return;
+				}
+
+				const float distance_squared = position.distance_squared(res.position);
+				if (count < k)
+				{
+					heap[count++] = nearest_neighbor{ res.index, distance_squared };
+					std::push_heap(heap, heap + count, heap_less);
+				}
+				else if (distance_squared < heap[0].distance_squared)
+				{
+					std::pop_heap(heap, heap + count, heap_less);
+					heap[count - 1] = nearest_neighbor{ res.index, distance_squared };
+					std::push_heap(heap, heap + count, heap_less);
+				}
+			};
+
+		const int32_t center = slot_of(position);
+		const int32_t center_x = center % cols;
+		const int32_t center_y = center / cols;
+		const int32_t max_ring = std::max({ center_x, cols - 1 - center_x, center_y, rows - 1 - center_y });
+
+		for (int32_t ring = 0; ring <= max_ring; ++ring)
+		{
+			const int32_t min_x = center_x - ring, max_x = center_x + ring;
+			const int32_t min_y = center_y - ring, max_y = center_y + ring;
+
+			const auto visit_row = [&](int32_t y)
 				{
-					resource const& res = resources[head - 1];
-					if (index != head - 1) // ignore self.
+					if (y >= 0 && y < rows)
 					{
-						vec2 const& found_position = res.position;
-						if (float distance_squared = position.distance_squared(found_position); distance_squared < radius_squared)
+						const grid* row = grids.data() + (y * cols);
+						for (int32_t x = std::max(min_x, 0); x <= std::min(max_x, cols - 1); ++x)
 						{
-							callable(head, distance_squared, found_position);
+							for_each_in_cell(row[x], visit);
 						}
 					}
-					head = res.next;
+				};
+			const auto visit_column = [&](int32_t x)
+				{
+					if (x >= 0 && x < cols)
+					{
+						for (int32_t y = std::max(min_y + 1, 0); y <= std::min(max_y - 1, rows - 1); ++y)
+						{
+							for_each_in_cell(grids[x + (y * cols)], visit);
+						}
+					}
+				};
+
+			visit_row(min_y);
+			if (ring > 0)
+			{
+				visit_row(max_y);
+				visit_column(min_x);
+				visit_column(max_x);
+			}
+
+			// Any particle outside the searched box is at least this far.
+			if (count == k)
+			{
+				const float margin = std::min({
+					position.x - min_x * cell_size, (max_x + 1) * cell_size - position.x,
+					position.y - min_y * cell_size, (max_y + 1) * cell_size - position.y });
+				if (margin > 0 && heap[0].distance_squared <= math::square(margin))
+				{
+					break;
 				}
 			}
 		}
+
+		std::sort_heap(heap, heap + count, heap_less);
+		return count;
+	}
+
+
+
+	void grid2d_accelerator::query_k_nearest_all(std::size_t k, std::span<nearest_neighbor> out) const noexcept
+	{
+		if (k == 0 || out.size() < k * slots.size()) [[unlikely]]
+		{
+			return;
+		}
+
+		const auto query = [&](resource const& res)
+			{
+				std::span<nearest_neighbor> entries = out.subspan(std::size_t(res.index) * k, k);
+				const std::size_t count = query_k_nearest(res.index, res.position, k, entries);
+				std::fill(entries.begin() + count, entries.end(), nearest_neighbor{ -1, 0.f });
+			};
+
+		// Walks the particles in storage order, which is cell order with the sorted layouts,
+		// so that consecutive queries touch the same cells.
+		if (layout == grid_layout::sorted_arrays)
+		{
+			for (int32_t slot = 0; slot < (int32_t)sorted_indices.size(); ++slot)
+			{
+				query(sorted_at(slot));
+			}
+		}
+		else
+		{
+			for (resource const& res : resources)
+			{
+				query(res);
+			}
+		}
+	}
+
+
+
+	raycast_hit grid2d_accelerator::raycast_first(std::size_t index, vec2 origin, vec2 direction, float max_distance, float radius) const noexcept
+	{
+		raycast_hit hit{ -1, max_distance };
+		const float length = std::sqrt(direction.length_squared());
+		if (length <= 0 || max_distance <= 0 || radius <= 0) [[unlikely]]
+		{
+			return hit;
+		}
+
+		const vec2 unit = direction / length;
+		const float radius_squared = math::square(radius);
+
+		walk_segment(origin, origin + unit * max_distance, radius,
+			[&](float t) { return t * max_distance <= hit.distance; },
+			[&](resource const& res)
+			{
+				if (index == (std::size_t)res.index) // ignore self.
+				{
+					return;
+				}
+
+				// Ray against disc: |offset - unit * t|^2 = radius^2.
+				const vec2 offset = res.position - origin;
+				const float projection = offset.x * unit.x + offset.y * unit.y;
+				const float excess = offset.length_squared() - radius_squared;
+				float distance = 0;
+				if (excess > 0)
+				{
+					const float discriminant = math::square(projection) - excess;
+					if (projection <= 0 || discriminant < 0)
+					{
+						return;
+					}
+					distance = projection - std::sqrt(discriminant);
+				}
+
+				if (distance < hit.distance || (distance == hit.distance && hit.index < 0))
+				{
+					hit = raycast_hit{ res.index, distance };
+				}
+			});
+
+		return hit;
 	}
 }
\ No newline at end of file
@@ -0,0 +1,150 @@
+﻿// Copyright (c) 2024 Fong ZiSing. All rights reserved.
+//
+//     HashAccelerator.cpp
+//
+
+#include "Starry/Engine/Public/Queries/HashAccelerator.hpp"
+
+#include <bit>
+#include <cstring>
+
+
+
+namespace se
+{
+	void hash2d_accelerator::rebuild(std::span<const se::vec2> positions)
+	{
+		resources.resize(positions.size());
+		slots.resize(positions.size());
+
+		// Keeps the load factor under 1/2 for the occupancy of the last frame, so the table tracks occupied cells.
+		clear_buckets(std::max(min_capacity, std::bit_ceil(occupied * 2 + 1)));
+
+		// Pass 1: counts the particles of each occupied cell.
+		const se::vec2* pos_ptr = positions.data();
+		bool rehashed = false;
+		for (std::size_t index = 0; index < positions.size(); ++index)
+		{
+			if ((occupied + 1) * 2 > buckets.size())
+			{
+				reserve_buckets(buckets.size() * 2);
+				rehashed = true;
+			}
+
+			vec2 const& position = pos_ptr[index];
+			const std::size_t slot = insert(key_of(coord_of(position.x), coord_of(position.y)));
+			buckets[slot].num++;
+			slots[index] = (int32_t)slot;
+		}
+
+		// Growing moved the buckets, looks them up again.
+		if (rehashed)
+		{
+			for (std::size_t index = 0; index < positions.size(); ++index)
+			{
+				vec2 const& position = pos_ptr[index];
+				slots[index] = (int32_t)(find(coord_of(position.x), coord_of(position.y)) - buckets.data());
+			}
+		}
+
+		// Pass 2: exclusive prefix sum, `begin` is used as the scatter cursor of each cell.
+		int32_t offset = 0;
+		for (bucket& curr : buckets)
+		{
+			curr.begin = offset;
+			offset += curr.num;
+		}
+
+		// Pass 3: scatters.
+		resource* res_ptr = resources.data();
+		for (std::size_t index = 0; index < positions.size(); ++index)
+		{
+			resource& last = res_ptr[buckets[slots[index]].begin++];
+			last.position = pos_ptr[index];
+			last.index = (int32_t)index;
+			last.reserved = 0;
+		}
+
+		for (bucket& curr : buckets)
+		{
+			curr.begin -= curr.num;
+		}
+	}
+
+
+
+	void hash2d_accelerator::query_near_of(std::size_t index, vec2 position, float radius, std::function<void(int, float, vec2 const)>&& callable) const
+	{
+		query_near_of<std::function<void(int, float, vec2 const)>&>(index, position, radius, callable);
+	}
+
+
+
+	accelerator_stats hash2d_accelerator::stats() const noexcept
+	{
+		return accelerator_stats
+		{
+			resources.size(),
+			occupied,
+			capacity_bytes_of(buckets, resources, slots),
+		};
+	}
+
+
+
+	std::size_t hash2d_accelerator::insert(uint64_t key) noexcept
+	{
+		const std::size_t mask = buckets.size() - 1;
+		for (std::size_t slot = home_of(key); ; slot = (slot + 1) & mask)
+		{
+			bucket& curr = buckets[slot];
+			if (curr.num == 0)
+			{
+				curr.key = key;
+				occupied++;
+				return slot;
+			}
+			if (curr.key == key)
+			{
+				return slot;
+			}
+		}
+	}
+
+
+
+	void hash2d_accelerator::reserve_buckets(std::size_t capacity)
+	{
+		if (capacity == buckets.size())
+		{
+			return;
+		}
+
+		std::vector<bucket> previous = std::move(buckets);
+		buckets.assign(capacity, bucket{});
+		occupied = 0;
+
+		for (bucket const& curr : previous)
+		{
+			if (curr.num != 0)
+			{
+				buckets[insert(curr.key)] = curr;
+			}
+		}
+	}
+
+
+
+	void hash2d_accelerator::clear_buckets(std::size_t capacity)
+	{
+		if (capacity == buckets.size())
+		{
+			std::memset(buckets.data(), 0, buckets.size() * sizeof(bucket));
+		}
+		else
+		{
+			buckets.assign(capacity, bucket{});
+		}
+		occupied = 0;
+	}
+}
\ No newline at end of file
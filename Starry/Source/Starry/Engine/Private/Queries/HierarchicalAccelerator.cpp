@@ -0,0 +1,250 @@
+﻿// Copyright (c) 2024 Fong ZiSing. All rights reserved.
+//
+//     HierarchicalAccelerator.cpp
+//
+
+#include "Starry/Engine/Public/Queries/HierarchicalAccelerator.hpp"
+
+#include <cstring>
+#include <limits>
+
+#define STARRY_USE_INTRINSIC
+#ifdef STARRY_USE_INTRINSIC
+#include "Starry/Core/Private/Intrinsic.hpp"
+#endif
+
+
+namespace se
+{
+	/** Levels are selected by a 32-bit mask. */
+	static constexpr std::size_t max_levels = 32;
+
+
+
+	void hierarchical_grid2d_accelerator::set_cell_sizes(std::span<const float> cell_sizes)
+	{
+		std::vector<float> sizes;
+		for (float cell_size : cell_sizes)
+		{
+			sizes.push_back(std::max(cell_size, 1e-3f));
+		}
+		if (sizes.empty())
+		{
+			sizes.push_back(8.f);
+		}
+		std::sort(sizes.begin(), sizes.end());
+		sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+		sizes.resize(std::min(sizes.size(), max_levels));
+
+		levels.clear();
+		for (float cell_size : sizes)
+		{
+			const int32_t cols = cells_along(bounds.x, cell_size);
+			const int32_t rows = cells_along(bounds.y, cell_size);
+			levels.push_back(level{ cell_size, 1.f / cell_size, cols, rows, std::vector<grid>(std::size_t(cols) * rows, grid{}) });
+		}
+
+		resources.clear();
+		slots.clear();
+		num_particles = 0;
+		indexed = false;
+	}
+
+
+
+	std::size_t hierarchical_grid2d_accelerator::level_of(float radius) const noexcept
+	{
+		// Particles tested plus rows visited, on the cells the query reaches.
+		std::size_t best = 0;
+		float best_cost = std::numeric_limits<float>::max();
+		for (std::size_t i = 0; i < levels.size(); ++i)
+		{
+			const level& curr = levels[i];
+			const float span = 2.f * std::ceil(radius * curr.inverse_cell_size) + 1.f;
+			const float span_x = std::min(span, float(curr.cols));
+			const float span_y = std::min(span, float(curr.rows));
+			const float cost = span_y * (row_cost + span_x * math::square(curr.cell_size) * density);
+			if (cost < best_cost)
+			{
+				best = i;
+				best_cost = cost;
+			}
+		}
+		return best;
+	}
+
+
+
+	void hierarchical_grid2d_accelerator::rebuild(std::span<const se::vec2> positions) noexcept
+	{
+		num_particles = positions.size();
+		density = float(num_particles) / std::max(float(bounds.x) * float(bounds.y), 1.f);
+		resources.resize(levels.size() * num_particles);
+		slots.resize(levels.size() * num_particles);
+
+		compute_slots(positions);
+		sort_by_slots(positions, uint32_t((uint64_t(1) << levels.size()) - 1));
+		indexed = true;
+	}
+
+
+
+	void hierarchical_grid2d_accelerator::update(std::span<const se::vec2> positions) noexcept
+	{
+		if (!indexed || positions.size() != num_particles)
+		{
+			rebuild(positions);
+			return;
+		}
+
+		const uint32_t crossed = compute_slots(positions);
+		const se::vec2* pos_ptr = positions.data();
+		for (std::size_t i = 0; i < levels.size(); ++i)
+		{
+			if ((crossed & (1u << i)) == 0)
+			{
+				// Same cells, same ranges, only refreshes the cached positions.
+				resource* first = resources.data() + i * num_particles;
+				resource* last = first + num_particles;
+				for (; first != last; ++first)
+				{
+					first->position = pos_ptr[first->index];
+				}
+			}
+		}
+
+		if (crossed != 0)
+		{
+			sort_by_slots(positions, crossed);
+		}
+	}
+
+
+
+	uint32_t hierarchical_grid2d_accelerator::compute_slots(std::span<const se::vec2> positions) noexcept
+	{
+		const se::vec2* pos_ptr = positions.data();
+		const std::size_t num = positions.size();
+		std::size_t index = 0;
+		uint32_t crossed = 0;
+
+#ifdef STARRY_USE_INTRINSIC
+		const int4 min_0000 = zero4i();
+		for (; index + 4 <= num; index += 4)
+		{
+			float4 floating_pos1 = load((const float*)(pos_ptr + index));
+			float4 floating_pos2 = load((const float*)(pos_ptr + index + 2));
+			float4 floating_xxxx = shuffle<0, 2, 0, 2>(floating_pos1, floating_pos2);
+			float4 floating_yyyy = shuffle<1, 3, 1, 3>(floating_pos1, floating_pos2);
+
+			// The four positions stay in registers for all levels.
+			for (std::size_t i = 0; i < levels.size(); ++i)
+			{
+				const level& curr = levels[i];
+				const float4 scale = make(curr.inverse_cell_size);
+				int4 clamped_xxxx = clamp(min_0000, make(curr.cols - 1), cast(mul(floating_xxxx, scale)));
+				int4 clamped_yyyy = clamp(min_0000, make(curr.rows - 1), cast(mul(floating_yyyy, scale)));
+				alignas(16) int32_t correct_slots[4];
+				store(add(mul(make(curr.cols), clamped_yyyy), clamped_xxxx), correct_slots);
+
+				int32_t* slot_ptr = slots.data() + i * num + index;
+				bool changed = false;
+				for (std::size_t lane = 0; lane < 4; ++lane)
+				{
+					changed |= slot_ptr[lane] != correct_slots[lane];
+					slot_ptr[lane] = correct_slots[lane];
+				}
+				crossed |= uint32_t(changed) << i;
+			}
+		}
+#endif
+		for (; index < num; ++index)
+		{
+			for (std::size_t i = 0; i < levels.size(); ++i)
+			{
+				int32_t& slot = slots[i * num + index];
+				const int32_t correct_slot = slot_of(levels[i], pos_ptr[index]);
+				crossed |= uint32_t(slot != correct_slot) << i;
+				slot = correct_slot;
+			}
+		}
+		return crossed;
+	}
+
+
+
+	void hierarchical_grid2d_accelerator::sort_by_slots(std::span<const se::vec2> positions, uint32_t level_mask) noexcept
+	{
+		// Cursors of all levels are laid out one after another.
+		std::size_t num_cells = 0;
+		for (level const& curr : levels)
+		{
+			num_cells += curr.grids.size();
+		}
+		cursors.resize(num_cells);
+
+		std::size_t cursor_offset = 0;
+		for (std::size_t i = 0; i < levels.size(); ++i)
+		{
+			level& curr = levels[i];
+			if (level_mask & (1u << i))
+			{
+				// Pass 1: counts the particles of each cell.
+				std::memset(curr.grids.data(), 0, curr.grids.size() * sizeof(grid));
+				const int32_t* slot_ptr = slots.data() + i * num_particles;
+				for (std::size_t index = 0; index < num_particles; ++index)
+				{
+					curr.grids[slot_ptr[index]].num++;
+				}
+
+				// Pass 2: exclusive prefix sum.
+				int32_t offset = 0;
+				int32_t* cursor = cursors.data() + cursor_offset;
+				for (std::size_t cell = 0; cell < curr.grids.size(); ++cell)
+				{
+					curr.grids[cell].begin = offset;
+					cursor[cell] = offset;
+					offset += curr.grids[cell].num;
+				}
+			}
+			cursor_offset += curr.grids.size();
+		}
+
+		// Pass 3: scatters every selected level in one pass, the particles of a cell keep their original order.
+		const se::vec2* pos_ptr = positions.data();
+		for (std::size_t index = 0; index < num_particles; ++index)
+		{
+			cursor_offset = 0;
+			for (std::size_t i = 0; i < levels.size(); ++i)
+			{
+				if (level_mask & (1u << i))
+				{
+					int32_t& cursor = cursors[cursor_offset + slots[i * num_particles + index]];
+					resources[i * num_particles + cursor++] = resource{ pos_ptr[index], (int32_t)index, 0 };
+				}
+				cursor_offset += levels[i].grids.size();
+			}
+		}
+	}
+
+
+
+	void hierarchical_grid2d_accelerator::query_near_of(std::size_t index, vec2 position, float radius, std::function<void(int, float, vec2 const)>&& callable) const
+	{
+		query_near_of<std::function<void(int, float, vec2 const)>&>(index, position, radius, callable);
+	}
+
+
+
+	accelerator_stats hierarchical_grid2d_accelerator::stats() const noexcept
+	{
+		std::size_t num_cells = 0;
+		std::size_t memory_bytes = capacity_bytes_of(levels, resources, slots, cursors);
+		for (level const& curr : levels)
+		{
+			num_cells += curr.grids.size();
+			memory_bytes += capacity_bytes_of(curr.grids);
+		}
+		return accelerator_stats{ num_particles, num_cells, memory_bytes };
+	}
+}
\ No newline at end of file
@@ -0,0 +1,95 @@
+﻿// Copyright (c) 2024 Fong ZiSing. All rights reserved.
+//
+//     NeighborList.cpp
+//
+
+#include "Starry/Engine/Public/Queries/NeighborList.hpp"
+
+
+
+namespace se
+{
+	bool verlet_neighbor_list::needs_rebuild(std::span<const se::vec2> positions) const noexcept
+	{
+		if (!built || positions.size() != reference_positions.size())
+		{
+			return true;
+		}
+
+		const float limit_squared = math::square(skin * 0.5f);
+		const se::vec2* reference = reference_positions.data();
+		if (is_periodic())
+		{
+			for (std::size_t i = 0; i < positions.size(); ++i)
+			{
+				if (grid->minimum_image(positions[i] - reference[i]).length_squared() > limit_squared)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		for (std::size_t i = 0; i < positions.size(); ++i)
+		{
+			if (positions[i].distance_squared(reference[i]) > limit_squared)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+
+
+	bool verlet_neighbor_list::update(grid2d_accelerator& accel, std::span<const se::vec2> positions)
+	{
+		if (grid != &accel || needs_rebuild(positions))
+		{
+			rebuild(accel, positions);
+			return true;
+		}
+
+		cached_positions.assign(positions.begin(), positions.end());
+		return false;
+	}
+
+
+
+	void verlet_neighbor_list::rebuild(grid2d_accelerator& accel, std::span<const se::vec2> positions)
+	{
+		accel.update(positions);
+		grid = &accel;
+
+		// Collects each pair once, then scatters it to both particles.
+		pairs.clear();
+		accel.for_each_pair(radius + skin, [this](int a, int b, float, vec2)
+			{
+				pairs.push_back(index_pair{ a, b });
+			});
+
+		const std::size_t num = positions.size();
+		offsets.assign(num + 1, 0);
+		for (index_pair const& pair : pairs)
+		{
+			offsets[pair.a + 1]++;
+			offsets[pair.b + 1]++;
+		}
+		for (std::size_t i = 0; i < num; ++i)
+		{
+			offsets[i + 1] += offsets[i];
+		}
+
+		cursors.assign(offsets.begin(), offsets.end() - 1);
+		indices.resize(pairs.size() * 2);
+		for (index_pair const& pair : pairs)
+		{
+			indices[cursors[pair.a]++] = pair.b;
+			indices[cursors[pair.b]++] = pair.a;
+		}
+
+		reference_positions.assign(positions.begin(), positions.end());
+		cached_positions.assign(positions.begin(), positions.end());
+		built = true;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,183 @@
+﻿// Copyright (c) 2024 Fong ZiSing. All rights reserved.
+//
+//     QuadtreeAccelerator.cpp
+//
+
+#include "Starry/Engine/Public/Queries/QuadtreeAccelerator.hpp"
+#include "Starry/Core/Public/ThreadPool.hpp"
+
+
+
+namespace se
+{
+	void quadtree2d_accelerator::rebuild(std::span<const se::vec2> positions)
+	{
+		build(positions, 1);
+	}
+
+
+
+	void quadtree2d_accelerator::par_rebuild(std::span<const se::vec2> positions)
+	{
+		constexpr std::size_t min_chunk_size = 4096;
+		build(positions, std::clamp<std::size_t>(positions.size() / min_chunk_size, 1, thread_pool::global().num_threads()));
+	}
+
+
+
+	void quadtree2d_accelerator::query_near_of(std::size_t index, vec2 position, float radius, std::function<void(int, float, vec2 const)>&& callable) const
+	{
+		query_near_of<std::function<void(int, float, vec2 const)>&>(index, position, radius, callable);
+	}
+
+
+
+	accelerator_stats quadtree2d_accelerator::stats() const noexcept
+	{
+		return accelerator_stats
+		{
+			resources.size(),
+			nodes.size(),
+			capacity_bytes_of(nodes, resources, keys),
+		};
+	}
+
+
+
+	void quadtree2d_accelerator::build(std::span<const se::vec2> positions, std::size_t num_chunks)
+	{
+		thread_pool& pool = thread_pool::global();
+		const std::size_t num = positions.size();
+		const std::size_t chunk_size = (num + num_chunks - 1) / std::max<std::size_t>(num_chunks, 1);
+		resources.resize(num);
+		keys.resize(num);
+		nodes.clear();
+		if (num == 0)
+		{
+			return;
+		}
+
+		// Pass 1: bounds of all particles.
+		std::vector<vec2> chunk_min(num_chunks, vec2{ std::numeric_limits<float>::max() });
+		std::vector<vec2> chunk_max(num_chunks, vec2{ std::numeric_limits<float>::lowest() });
+		pool.parallel_for(num_chunks, [&](std::size_t chunk)
+			{
+				const std::size_t first = chunk * chunk_size;
+				const std::size_t last = std::min(first + chunk_size, num);
+				for (std::size_t i = first; i < last; ++i)
+				{
+					chunk_min[chunk] = vec2{ std::min(chunk_min[chunk].x, positions[i].x), std::min(chunk_min[chunk].y, positions[i].y) };
+					chunk_max[chunk] = vec2{ std::max(chunk_max[chunk].x, positions[i].x), std::max(chunk_max[chunk].y, positions[i].y) };
+				}
+			});
+
+		vec2 bounds_min = chunk_min[0], bounds_max = chunk_max[0];
+		for (std::size_t chunk = 1; chunk < num_chunks; ++chunk)
+		{
+			bounds_min = vec2{ std::min(bounds_min.x, chunk_min[chunk].x), std::min(bounds_min.y, chunk_min[chunk].y) };
+			bounds_max = vec2{ std::max(bounds_max.x, chunk_max[chunk].x), std::max(bounds_max.y, chunk_max[chunk].y) };
+		}
+
+		// Pass 2: Morton code in the high bits, original index in the low bits, each chunk sorted on its own.
+		const float extent = std::max({ bounds_max.x - bounds_min.x, bounds_max.y - bounds_min.y, 1e-6f });
+		const float scale = 65535.f / extent;
+		pool.parallel_for(num_chunks, [&](std::size_t chunk)
+			{
+				const std::size_t first = chunk * chunk_size;
+				const std::size_t last = std::min(first + chunk_size, num);
+				for (std::size_t i = first; i < last; ++i)
+				{
+					const uint16_t x = (uint16_t)std::clamp((positions[i].x - bounds_min.x) * scale, 0.f, 65535.f);
+					const uint16_t y = (uint16_t)std::clamp((positions[i].y - bounds_min.y) * scale, 0.f, 65535.f);
+					keys[i] = (uint64_t(math::morton_encode(x, y)) << 32) | uint64_t(i);
+				}
+				std::sort(keys.begin() + first, keys.begin() + last);
+			});
+
+		// Pass 3: merges sorted chunks pairwise, log2(num_chunks) rounds.
+		for (std::size_t width = 1; width < num_chunks; width *= 2)
+		{
+			const std::size_t num_merges = (num_chunks + 2 * width - 1) / (2 * width);
+			pool.parallel_for(num_merges, [&](std::size_t merge)
+				{
+					const std::size_t first = std::min(merge * 2 * width * chunk_size, num);
+					const std::size_t middle = std::min(first + width * chunk_size, num);
+					const std::size_t last = std::min(middle + width * chunk_size, num);
+					std::inplace_merge(keys.begin() + first, keys.begin() + middle, keys.begin() + last);
+				});
+		}
+
+		// Pass 4: scatters resources in Morton order.
+		pool.parallel_for(num_chunks, [&](std::size_t chunk)
+			{
+				const std::size_t first = chunk * chunk_size;
+				const std::size_t last = std::min(first + chunk_size, num);
+				for (std::size_t i = first; i < last; ++i)
+				{
+					const uint32_t index = uint32_t(keys[i]);
+					resources[i] = resource{ positions[index], (int32_t)index, 0 };
+				}
+			});
+
+		build_nodes();
+	}
+
+
+
+	void quadtree2d_accelerator::build_nodes()
+	{
+		const auto level_bits = [](uint64_t key, int32_t level)
+			{
+				return uint32_t(key >> (32 + 30 - 2 * level)) & 3u;
+			};
+
+		// Breadth-first, so that the four children of a node are appended together.
+		nodes.push_back(node{ {}, {}, -1, 0, (int32_t)resources.size(), 0 });
+		for (std::size_t current = 0; current < nodes.size(); ++current)
+		{
+			const node parent = nodes[current];
+			if (parent.end - parent.begin <= leaf_capacity || parent.level >= max_level)
+			{
+				continue;
+			}
+
+			// Particles of a node share the Morton prefix, the next two bits split them into quadrants.
+			nodes[current].first_child = (int32_t)nodes.size();
+			auto first = keys.begin() + parent.begin;
+			const auto last = keys.begin() + parent.end;
+			for (uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+			{
+				const auto middle = std::partition_point(first, last, [&](uint64_t key) { return level_bits(key, parent.level) <= quadrant; });
+				nodes.push_back(node{ {}, {}, -1, int32_t(first - keys.begin()), int32_t(middle - keys.begin()), parent.level + 1 });
+				first = middle;
+			}
+		}
+
+		// Tight bounds bottom-up, children always follow their parent.
+		for (std::size_t i = nodes.size(); i-- > 0;)
+		{
+			node& curr = nodes[i];
+			curr.min = vec2{ std::numeric_limits<float>::max() };
+			curr.max = vec2{ std::numeric_limits<float>::lowest() };
+
+			if (curr.first_child >= 0)
+			{
+				for (int32_t child = 0; child < 4; ++child)
+				{
+					node const& sub = nodes[curr.first_child + child];
+					curr.min = vec2{ std::min(curr.min.x, sub.min.x), std::min(curr.min.y, sub.min.y) };
+					curr.max = vec2{ std::max(curr.max.x, sub.max.x), std::max(curr.max.y, sub.max.y) };
+				}
+			}
+			else
+			{
+				for (int32_t slot = curr.begin; slot < curr.end; ++slot)
+				{
+					vec2 const& position = resources[slot].position;
+					curr.min = vec2{ std::min(curr.min.x, position.x), std::min(curr.min.y, position.y) };
+					curr.max = vec2{ std::max(curr.max.x, position.x), std::max(curr.max.y, position.y) };
+				}
+			}
+		}
+	}
+}
\ No newline at end of file
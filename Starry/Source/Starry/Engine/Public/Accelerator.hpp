@@ -5,4 +5,24 @@
 
 #pragma once
 
-#include "Queries/GridAccelerator.hpp"
\ No newline at end of file
+#include "Queries/AcceleratorConcept.hpp"
+#include "Queries/BroadPhase.hpp"
+#include "Queries/GridAccelerator.hpp"
+#include "Queries/DoubleBufferedAccelerator.hpp"
+#include "Queries/Grid3DAccelerator.hpp"
+#include "Queries/HashAccelerator.hpp"
+#include "Queries/HierarchicalAccelerator.hpp"
+#include "Queries/QuadtreeAccelerator.hpp"
+#include "Queries/NeighborList.hpp"
+
+
+
+namespace se
+{
+	// The indexes shipped with the engine, the 2D ones can be dropped into `scene2d`.
+	static_assert(accelerator<grid2d_accelerator>);
+	static_assert(accelerator<hash2d_accelerator>);
+	static_assert(accelerator<hierarchical_grid2d_accelerator>);
+	static_assert(accelerator<quadtree2d_accelerator>);
+	static_assert(accelerator<grid3d_accelerator, vec3>);
+}
\ No newline at end of file
@@ -8,53 +8,98 @@
 #include "Reflection.hpp"
 
 #include <vector>
-#include <unordered_map>
 #include <span>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <numeric>
 
 
 
 namespace se::ecs
 {
+	/** Every component stream starts on a cache line, and is padded with zeros to the next one. */
+	static constexpr std::size_t component_alignment = 64;
+
+	[[nodiscard]] constexpr std::size_t padded_bytes_of(std::size_t bytes) noexcept
+	{
+		return (bytes + component_alignment - 1) & ~(component_alignment - 1);
+	}
+
+
+
+	/**
+	 * @brief Moves the element at `from` into the hole at `to`, one step of a swap-and-pop compaction.
+	 */
+	struct compaction_move
+	{
+		uint32_t to;
+		uint32_t from;
+	};
+
+	/**
+	 * @brief Plans the swap-and-pop compaction of the entities flagged in `dead`, partitioning the mask in one pass:
+	 *        the first dead entities are refilled by the last live ones, 16 flags per SIMD compare.
+	 * @param dead Non-zero for the entities to destroy, entities past its end are live.
+	 * @param num Number of entities.
+	 * @param moves Receives the moves, in increasing `to` and decreasing `from` order.
+	 * @return The number of live entities, the size of the streams after compaction.
+	 * @details 规划删除实体后的压缩（交换并弹出）
+	 */
+	std::size_t plan_compaction(std::span<const uint8_t> dead, std::size_t num, std::vector<compaction_move>& moves);
+
+
+
+	/**
+	 * @brief One attribute of all entities of an archetype, a view into the arena of the archetype.
+	 * @details 组件数据流，指向原型内存池中的一段
+	 */
 	struct component
 	{
 	private:
+		friend class component_arena;
 		const std::size_t bytes;
 		std::size_t num;
-		std::vector<uint8_t> buffer;
+		uint8_t* buffer;
 
 
 	public:
 		explicit component(std::size_t in_bytes) noexcept
 			: bytes(in_bytes)
 			, num(0)
+			, buffer(nullptr)
 		{}
 
-		[[msvc::forceinline]] void resize(std::size_t const in_size)
+		[[nodiscard]][[msvc::forceinline]] std::size_t size() const noexcept
 		{
-			num = in_size;
-			buffer.resize(in_size * bytes);
+			return num;
 		}
 
-		[[nodiscard]][[msvc::forceinline]] std::size_t size() const noexcept
+		/**
+		 * @brief Retrieves the bytes readable from `data()`, `size()` elements rounded up to `component_alignment`,
+		 *        the padding past the last element is zero. SIMD loops may run over it without a remainder loop.
+		 */
+		[[nodiscard]][[msvc::forceinline]] std::size_t padded_bytes() const noexcept
 		{
-			return num;
+			return padded_bytes_of(num * bytes);
 		}
 
+		/** Aligned to `component_alignment` when `start` is 0. */
 		[[nodiscard]][[msvc::forceinline]] uint8_t* data(std::size_t const start = 0) noexcept
 		{
-			return buffer.data() + start * bytes;
+			return buffer + start * bytes;
 		}
 
 		[[nodiscard]][[msvc::forceinline]] uint8_t const* data(std::size_t const start = 0) const noexcept
 		{
-			return buffer.data() + start * bytes;
+			return buffer + start * bytes;
 		}
 
 		template<typename _cast_t = uint8_t>
 		void for_each(auto& callable)
 		{
 			std::size_t fixed_size = bytes * num / sizeof(_cast_t);
-			_cast_t* first = reinterpret_cast<_cast_t*>(buffer.data());
+			_cast_t* first = reinterpret_cast<_cast_t*>(buffer);
 			const _cast_t* last = first + fixed_size;
 
 			while (first != last)
@@ -68,7 +113,7 @@ namespace se::ecs
 		void for_each(auto&& callable) const
 		{
 			std::size_t fixed_size = bytes * num / sizeof(_cast_t);
-			const _cast_t* first = reinterpret_cast<const _cast_t*>(buffer.data());
+			const _cast_t* first = reinterpret_cast<const _cast_t*>(buffer);
 			const _cast_t* last = first + fixed_size;
 
 			while (first != last)
@@ -78,6 +123,239 @@ namespace se::ecs
 			}
 		}
 	};
+
+
+
+	/**
+	 * @brief All components of an archetype in one allocation. Each stream starts on a cache line,
+	 *        so that streams never share a line and SIMD kernels may use aligned loads.
+	 * @details 原型的组件内存池，所有组件共享一次分配，按缓存行对齐
+	 */
+	class component_arena
+	{
+	private:
+		std::vector<component> fields;
+		uint8_t* block = nullptr;
+		uint8_t* scratch = nullptr;
+		std::size_t block_bytes = 0;
+		std::size_t num = 0;
+		std::size_t capacity = 0;
+
+
+	public:
+		component_arena() noexcept = default;
+
+		component_arena(component_arena&& other) noexcept
+			: fields(std::move(other.fields))
+			, block(std::exchange(other.block, nullptr))
+			, scratch(std::exchange(other.scratch, nullptr))
+			, block_bytes(std::exchange(other.block_bytes, 0))
+			, num(std::exchange(other.num, 0))
+			, capacity(std::exchange(other.capacity, 0))
+		{}
+
+		~component_arena()
+		{
+			release(block);
+			release(scratch);
+		}
+
+		void add_field(std::size_t in_bytes)
+		{
+			fields.emplace_back(in_bytes);
+		}
+
+		[[nodiscard]] std::size_t num_fields() const noexcept
+		{
+			return fields.size();
+		}
+
+		[[nodiscard]][[msvc::forceinline]] std::size_t size() const noexcept
+		{
+			return num;
+		}
+
+		[[nodiscard]][[msvc::forceinline]] component& operator[] (std::size_t index) noexcept
+		{
+			return fields[index];
+		}
+
+		[[nodiscard]][[msvc::forceinline]] component const& operator[] (std::size_t index) const noexcept
+		{
+			return fields[index];
+		}
+
+		/**
+		 * @brief Retrieves the smallest number of elements that fills whole cache lines in every stream,
+		 *        ranges starting at a multiple of it never share a line with the previous range.
+		 */
+		[[nodiscard]] std::size_t line_granularity() const noexcept
+		{
+			std::size_t granularity = 1;
+			for (component const& field : fields)
+			{
+				granularity = std::lcm(granularity, component_alignment / std::gcd(component_alignment, field.bytes));
+			}
+			return granularity;
+		}
+
+		/**
+		 * @brief Resizes all streams, new elements are zero. Grows the arena geometrically.
+		 */
+		void resize(std::size_t const in_size)
+		{
+			if (in_size > capacity)
+			{
+				reallocate(std::max(in_size, capacity * 2));
+			}
+
+			for (component& field : fields)
+			{
+				if (in_size > num)
+				{
+					std::memset(field.buffer + num * field.bytes, 0, (in_size - num) * field.bytes);
+				}
+				field.num = in_size;
+				clear_padding(field);
+			}
+			num = in_size;
+		}
+
+		/**
+		 * @brief Reorders the elements of all streams so that the i-th element becomes the `order[i]`-th element of before.
+		 *        Gathers into a second arena of the same layout, then swaps them.
+		 */
+		void permute(std::span<const uint32_t> order)
+		{
+			if (scratch == nullptr)
+			{
+				scratch = allocate(block_bytes);
+			}
+
+			for (component& field : fields)
+			{
+				uint8_t* dst = scratch + (field.buffer - block);
+				const uint8_t* src = field.buffer;
+
+				const auto gather = [&]<std::size_t n>()
+					{
+						for (std::size_t i = 0; i < order.size(); ++i)
+						{
+							std::memcpy(dst + i * n, src + order[i] * n, n);
+						}
+					};
+
+				switch (field.bytes)
+				{
+				case 4:  gather.template operator()<4>(); break;
+				case 8:  gather.template operator()<8>(); break;
+				case 16: gather.template operator()<16>(); break;
+				default:
+					for (std::size_t i = 0; i < order.size(); ++i)
+					{
+						std::memcpy(dst + i * field.bytes, src + order[i] * field.bytes, field.bytes);
+					}
+					break;
+				}
+			}
+
+			for (component& field : fields)
+			{
+				field.buffer = scratch + (field.buffer - block);
+				clear_padding(field);
+			}
+			std::swap(block, scratch);
+		}
+
+		/**
+		 * @brief Applies the moves of a compaction to all streams, then shrinks them to `live` elements.
+		 */
+		void compact(std::span<const compaction_move> moves, std::size_t const live)
+		{
+			for (component& field : fields)
+			{
+				uint8_t* buffer = field.buffer;
+
+				const auto move = [&]<std::size_t n>()
+					{
+						for (compaction_move const& step : moves)
+						{
+							std::memcpy(buffer + step.to * n, buffer + step.from * n, n);
+						}
+					};
+
+				switch (field.bytes)
+				{
+				case 4:  move.template operator()<4>(); break;
+				case 8:  move.template operator()<8>(); break;
+				case 16: move.template operator()<16>(); break;
+				default:
+					for (compaction_move const& step : moves)
+					{
+						std::memcpy(buffer + step.to * field.bytes, buffer + step.from * field.bytes, field.bytes);
+					}
+					break;
+				}
+			}
+			resize(live);
+		}
+
+
+	private:
+		[[nodiscard]] static uint8_t* allocate(std::size_t in_bytes)
+		{
+			return static_cast<uint8_t*>(::operator new(std::max(in_bytes, component_alignment), std::align_val_t{ component_alignment }));
+		}
+
+		static void release(uint8_t* in_block) noexcept
+		{
+			if (in_block != nullptr)
+			{
+				::operator delete(in_block, std::align_val_t{ component_alignment });
+			}
+		}
+
+		static void clear_padding(component& field) noexcept
+		{
+			const std::size_t used = field.num * field.bytes;
+			std::memset(field.buffer + used, 0, padded_bytes_of(used) - used);
+		}
+
+		/** Moves every stream to a new arena of `in_capacity` elements per stream. */
+		void reallocate(std::size_t in_capacity)
+		{
+			std::size_t total = 0;
+			for (component const& field : fields)
+			{
+				total += padded_bytes_of(in_capacity * field.bytes);
+			}
+
+			uint8_t* new_block = allocate(total);
+			std::size_t offset = 0;
+			for (component& field : fields)
+			{
+				if (num != 0)
+				{
+					std::memcpy(new_block + offset, field.buffer, num * field.bytes);
+				}
+				field.buffer = new_block + offset;
+				offset += padded_bytes_of(in_capacity * field.bytes);
+			}
+
+			release(block);
+			release(scratch);
+			block = new_block;
+			scratch = nullptr;
+			block_bytes = total;
+			capacity = in_capacity;
+		}
+
+
+	private:
+		/** Non-copyable. */
+		component_arena(const component_arena&) = delete;
+		component_arena& operator = (const component_arena&) = delete;
+	};
 }
 
 
@@ -91,46 +369,85 @@ namespace se::ecs
 	class component_archetypes
 	{
 	public:
-		using value_type = std::vector<component>;
-		using hash_type = uint32_t;
-		using hash_map = std::unordered_map<hash_type, value_type>;
+		using value_type = component_arena;
 
 
 	private:
-		hash_map map{};
+		/** Indexed by `index_of_archetype()`. */
+		std::vector<value_type> arenas;
 
 
 	public:
+		component_archetypes()
+		{
+			arenas.resize(num_archetypes());
+		}
+
 		template <typename _object_t>
 		[[msvc::forceinline]] value_type& add_unique()
 		{
-			constexpr uint32_t hash = hashcode_of_type<_object_t>();
-			std::pair<hash_map::iterator, bool> result = map.try_emplace(hash);
-			value_type& components = result.first->second;
-
-			if (result.second)
+			const uint32_t index = index_of_archetype<_object_t>();
+			if (index >= arenas.size())
 			{
-				constexpr auto reflect = reflection<_object_t>::config();
-				components.reserve(reflect.num_fields());
-				reflect.for_each_fields(
-					[&components](auto& field)
-					{
-						components.emplace_back(field.static_bytes);
-					});
+				// The type was registered after this manager was made.
+				arenas.resize(index + 1);
+			}
 
+			value_type& components = arenas[index];
+			if (components.num_fields() == 0)
+			{
+				add_fields_of<_object_t>(components);
 			}
 
 			return components;
 		}
 
-		[[nodiscard]] [[msvc::forceinline]] value_type& operator[] (hash_type hash)
+		/**
+		 * @brief Retrieves the arena of a type, set up with its reflected fields on first lookup.
+		 */
+		template <typename _object_t>
+		[[nodiscard]][[msvc::forceinline]] value_type& get()
+		{
+			return add_unique<_object_t>();
+		}
+
+		/**
+		 * @brief Retrieves the arena of a type, an empty one with its reflected fields if none was made yet.
+		 */
+		template <typename _object_t>
+		[[nodiscard]][[msvc::forceinline]] value_type const& get() const
 		{
-			return map.at(hash);
+			const uint32_t index = index_of_archetype<_object_t>();
+			if (index < arenas.size() && arenas[index].num_fields() != 0)
+			{
+				return arenas[index];
+			}
+			return empty_of<_object_t>();
 		}
 
-		[[nodiscard]] [[msvc::forceinline]] value_type const& operator[] (hash_type hash) const
+
+	private:
+		template <typename _object_t>
+		static void add_fields_of(value_type& components)
 		{
-			return map.at(hash);
+			constexpr auto reflect = reflection<_object_t>::config();
+			reflect.for_each_fields(
+				[&components](auto& field)
+				{
+					components.add_field(field.static_bytes);
+				});
+		}
+
+		template <typename _object_t>
+		[[nodiscard]] static value_type const& empty_of()
+		{
+			static const value_type empty = []
+				{
+					value_type components;
+					add_fields_of<_object_t>(components);
+					return components;
+				}();
+			return empty;
 		}
 	};
 }
@@ -161,24 +478,43 @@ namespace se::ecs
 			constexpr auto reflect = reflection<_object_t>::config();
 
 			// Allocation.
-			std::vector<component>& components = archetypes.add_unique<_object_t>();
-			for (component& per_component : components)
-			{
-				per_component.resize(per_component.size() + objects.size());
-			}
+			component_arena& components = archetypes.add_unique<_object_t>();
+			const std::size_t first = components.size();
+			components.resize(first + objects.size());
 
 			for (std::size_t i = 0; i < objects.size(); ++i)
 			{
 				reflect.copy_fields(
 					objects[i],
-					[i, &components](std::size_t component_index)
+					[first, i, &components](std::size_t component_index)
 					{
-						return components[component_index].data(i);
+						return components[component_index].data(first + i);
 					}
 				);
 			}
 		}
 
+		/**
+		 * @brief Reorders all components of the given entity with one permutation,
+		 *        the i-th entity becomes the `order[i]`-th entity of before.
+		 * @details 按同一排列重排实体的所有组件
+		 */
+		template <typename _object_t>
+		void permute(std::span<const uint32_t> order)
+		{
+			archetypes.get<_object_t>().permute(order);
+		}
+
+		/**
+		 * @brief Compacts all components of the given entity, see `plan_compaction()`.
+		 * @details 压缩实体的所有组件
+		 */
+		template <typename _object_t>
+		void compact(std::span<const compaction_move> moves, std::size_t const live)
+		{
+			archetypes.get<_object_t>().compact(moves, live);
+		}
+
 		/**
 		 * @brief Retrieves the given component of the given entity.
 		 * @return 返回给定实体的特定组件
@@ -189,9 +525,8 @@ namespace se::ecs
 			// Gets compile-time reflection information of entity.
 			constexpr auto reflect = reflection<_object_t>::config();
 
-			// Calculates the hash value of entity in compile-time, uses it to find the entity.
-			constexpr uint32_t hash = hashcode_of_type<_object_t>();
-			const std::vector<component>& components = archetypes[hash];
+			// Finds the archetype at its static slot.
+			const component_arena& components = archetypes.get<_object_t>();
 
 			// Indexes to the corresponding component based on reflection information and return it.
 			constexpr auto field = reflect.get_field<attr>();
@@ -199,6 +534,52 @@ namespace se::ecs
 			return std::span<const data_t>((const data_t*)components[field.static_index].data(), components[field.static_index].size());
 		}
 
+		/**
+		 * @brief Retrieves the given component of the given entity, writable.
+		 * @return 返回给定实体的特定组件（可写）
+		 */
+		template<typename _object_t, string_literal attr>
+		decltype(auto) any_of()
+		{
+			constexpr auto reflect = reflection<_object_t>::config();
+			component_arena& components = archetypes.get<_object_t>();
+
+			constexpr auto field = reflect.get_field<attr>();
+			using data_t = decltype(field)::member_type;
+			return std::span<data_t>((data_t*)components[field.static_index].data(), components[field.static_index].size());
+		}
+
+		/**
+		 * @brief Retrieves the smallest number of entities that fills whole cache lines in every component,
+		 *        see `component_arena::line_granularity()`.
+		 */
+		template <typename _object_t>
+		[[nodiscard]] std::size_t line_granularity() const noexcept
+		{
+			return archetypes.get<_object_t>().line_granularity();
+		}
+
+		/**
+		 * @brief Invokes `callable(index, attributes...)` for the entities in [first, last), as `for_each` does.
+		 *        Used to split a traversal into disjoint ranges.
+		 * @details 遍历给定区间内实体的组件
+		 */
+		template<typename _object_t, string_literal... attrs>
+		void for_each_in(std::size_t const first, std::size_t const last, auto&& callable)
+		{
+			visit_range<_object_t, true, attrs...>(archetypes.get<_object_t>(), first, last, callable);
+		}
+
+		/**
+		 * @brief Invokes `callable(index, attributes...)` for the entities in [first, last), read-only.
+		 * @details 遍历给定区间内实体的组件（只读）
+		 */
+		template<typename _object_t, string_literal... attrs>
+		void for_each_in(std::size_t const first, std::size_t const last, auto&& callable) const
+		{
+			visit_range<_object_t, true, attrs...>(archetypes.get<_object_t>(), first, last, callable);
+		}
+
 		/**
 		 * @brief Traverses the given component of the given entity.
 		 * @details 遍历给定实体的特定组件
@@ -206,48 +587,20 @@ namespace se::ecs
 		template<typename _object_t, string_literal... attrs>
 		void for_each(auto&& callable)
 		{
-			// Gets compile-time reflection information of entity.
-			constexpr auto reflect = reflection<_object_t>::config();
+			// Finds the archetype at its static slot.
+			component_arena& components = archetypes.get<_object_t>();
 
-			// Calculates the hash value of entity in compile-time, uses it to find the entity.
-			constexpr uint32_t hash = hashcode_of_type<_object_t>();
-			std::vector<component>& components = archetypes[hash];
-
-			// Indexes to the corresponding component based on reflection information and traverse it.
-			if constexpr (sizeof...(attrs) == 0)
-			{
-				const std::size_t component_size = components[0].size();
-				for (std::size_t i = 0; i < component_size; ++i)
-				{
-					reflect.visit_fields(
-						[i, &components](std::size_t component_index)
-						{
-							return components[component_index].data(i);
-						},
-						callable, i
-					);
-				}
-			}
-			else if constexpr (sizeof...(attrs) == 1)
+			// A single attribute is one contiguous stream.
+			if constexpr (sizeof...(attrs) == 1)
 			{
+				constexpr auto reflect = reflection<_object_t>::config();
 				constexpr auto field = reflect.get_field<attrs...>();
 				using data_t = decltype(field)::member_type;
 				components[field.static_index].for_each<data_t>(callable);
 			}
 			else
 			{
-				constexpr auto filter_reflect = reflect.filter_object<attrs...>();
-				const std::size_t component_size = components[0].size();
-				for (std::size_t i = 0; i < component_size; ++i)
-				{
-					filter_reflect.visit_fields(
-						[i, &components](std::size_t component_index)
-						{
-							return components[component_index].data(i);
-						},
-						callable, i
-					);
-				}
+				visit_range<_object_t, true, attrs...>(components, 0, components.size(), callable);
 			}
 		}
 
@@ -258,45 +611,59 @@ namespace se::ecs
 		template<typename _object_t, string_literal... attrs>
 		void for_each(auto&& callable) const
 		{
-			// Gets compile-time reflection information of entity.
-			constexpr auto reflect = reflection<_object_t>::config();
-			constexpr uint32_t hash = hashcode_of_type<_object_t>();
-
-			// Indexes to the corresponding component based on reflection information and traverse it.
-			const std::vector<component>& components = archetypes[hash];
-			if constexpr (sizeof...(attrs) == 0)
-			{
-				const std::size_t component_size = components[0].size();
-				for (std::size_t i = 0; i < component_size; ++i)
-				{
-					reflect.visit_fields(
-						[i, &components](std::size_t component_index)
-						{
-							return components[component_index].data(i);
-						},
-						callable
-					);
-				}
-			}
-			else if constexpr (sizeof...(attrs) == 1)
+			const component_arena& components = archetypes.get<_object_t>();
+			if constexpr (sizeof...(attrs) == 1)
 			{
+				constexpr auto reflect = reflection<_object_t>::config();
 				constexpr auto field = reflect.get_field<attrs...>();
 				using data_t = decltype(field)::member_type;
 				components[field.static_index].for_each<data_t>(callable);
 			}
 			else
 			{
-				constexpr auto filter_reflect = reflect.filter_object<attrs...>();
-				const std::size_t component_size = components[0].size();
-				for (std::size_t i = 0; i < component_size; ++i)
+				visit_range<_object_t, false, attrs...>(components, 0, components.size(), callable);
+			}
+		}
+
+
+	private:
+		/** Reflection information of the given attributes, or of all of them if none is given. */
+		template <typename _object_t, string_literal... attrs>
+		static consteval auto fields_of()
+		{
+			constexpr auto reflect = reflection<_object_t>::config();
+			if constexpr (sizeof...(attrs) == 0)
+			{
+				return reflect;
+			}
+			else
+			{
+				return reflect.filter_object<attrs...>();
+			}
+		}
+
+		/**
+		 * Indexes to the components of the entities in [first, last) based on reflection information,
+		 * and invokes `callable(index, attributes...)`, or `callable(attributes...)` without `with_index`.
+		 */
+		template <typename _object_t, bool with_index, string_literal... attrs>
+		static void visit_range(auto& components, std::size_t const first, std::size_t const last, auto&& callable)
+		{
+			constexpr auto filter_reflect = fields_of<_object_t, attrs...>();
+			for (std::size_t i = first; i < last; ++i)
+			{
+				const auto component_of = [i, &components](std::size_t component_index)
+					{
+						return components[component_index].data(i);
+					};
+
+				if constexpr (with_index)
 				{
-					filter_reflect.visit_fields(
-						[i, &components](std::size_t component_index)
-						{
-							return components[component_index].data(i);
-						},
-						callable
-					);
+					filter_reflect.visit_fields(component_of, callable, i);
+				}
+				else
+				{
+					filter_reflect.visit_fields(component_of, callable);
 				}
 			}
 		}
@@ -10,15 +10,153 @@
 #include <cstdint>
 #include <vector>
 #include <span>
-#include <unordered_map>
 
 
 
 namespace se::ecs
 {
+	/**
+	 * @brief Stable handle of an entity, valid across reordering and compaction until the entity is destroyed.
+	 *        `index` names a slot of the sparse table, `generation` counts the entities that held the slot before.
+	 * @details 实体句柄（稀疏索引 + 代数）
+	 */
 	struct entity
 	{
-		int32_t id;
+		uint32_t index;
+		uint32_t generation;
+
+		[[nodiscard]] friend constexpr bool operator == (entity const&, entity const&) noexcept = default;
+	};
+
+
+
+	/**
+	 * @brief Entities of one archetype: handles in dense (component) order, and the sparse table mapping
+	 *        a handle back to its dense index, so that resolving a handle is two array reads.
+	 * @details 单一原型的实体表，稠密数组与稀疏索引表双向映射
+	 */
+	class entity_table
+	{
+	public:
+		/** Dense index of a destroyed or unknown handle. */
+		static constexpr std::size_t invalid_index = ~std::size_t(0);
+
+
+	private:
+		struct slot
+		{
+			/** Dense index of the entity, or the next free slot once destroyed. */
+			uint32_t dense;
+			uint32_t generation;
+		};
+
+		static constexpr uint32_t end_of_free_list = ~uint32_t(0);
+
+		std::vector<entity> dense;
+		std::vector<slot> sparse;
+		uint32_t free_head = end_of_free_list;
+
+		/** Reused by `permute()`, swapped with `dense`. */
+		std::vector<entity> scratch;
+
+
+	public:
+		[[nodiscard]] std::size_t size() const noexcept
+		{
+			return dense.size();
+		}
+
+		/**
+		 * @brief Retrieves the handle of the entity at a dense index.
+		 */
+		[[nodiscard]][[msvc::forceinline]] entity operator[] (std::size_t index) const noexcept
+		{
+			return dense[index];
+		}
+
+		/**
+		 * @brief Retrieves the dense index of the entity, or `invalid_index` if it was destroyed.
+		 */
+		[[nodiscard]][[msvc::forceinline]] std::size_t index_of(entity handle) const noexcept
+		{
+			if (handle.index < sparse.size() && sparse[handle.index].generation == handle.generation)
+			{
+				return sparse[handle.index].dense;
+			}
+			return invalid_index;
+		}
+
+		/**
+		 * @brief Appends `count` entities, reusing the slots of destroyed ones first.
+		 */
+		void generate(std::size_t count)
+		{
+			dense.reserve(dense.size() + count);
+			while (count--)
+			{
+				uint32_t index = free_head;
+				if (index != end_of_free_list)
+				{
+					free_head = sparse[index].dense;
+				}
+				else
+				{
+					index = (uint32_t)sparse.size();
+					sparse.push_back(slot{ 0, 0 });
+				}
+				sparse[index].dense = (uint32_t)dense.size();
+				dense.push_back(entity{ index, sparse[index].generation });
+			}
+		}
+
+		/**
+		 * @brief Reorders entities, the i-th entity becomes the `order[i]`-th entity of before.
+		 */
+		void permute(std::span<const uint32_t> order)
+		{
+			scratch.resize(order.size());
+			for (std::size_t to = 0; to < order.size(); ++to)
+			{
+				const entity moved = dense[order[to]];
+				sparse[moved.index].dense = (uint32_t)to;
+				scratch[to] = moved;
+			}
+			dense.swap(scratch);
+		}
+
+		/**
+		 * @brief Moves entities into the holes of destroyed ones, then keeps the first `live` entities.
+		 *        Entities overwritten by a move, and the ones left past `live`, are destroyed.
+		 */
+		template <typename _move_t>
+		void compact(std::span<const _move_t> moves, std::size_t live)
+		{
+			for (_move_t const& step : moves)
+			{
+				release(dense[step.to]);
+				dense[step.to] = dense[step.from];
+				sparse[dense[step.to].index].dense = step.to;
+				dense[step.from].index = end_of_free_list;
+			}
+			for (std::size_t index = live; index < dense.size(); ++index)
+			{
+				if (dense[index].index != end_of_free_list)
+				{
+					release(dense[index]);
+				}
+			}
+			dense.resize(live);
+		}
+
+
+	private:
+		void release(entity handle) noexcept
+		{
+			slot& destroyed = sparse[handle.index];
+			destroyed.generation++;
+			destroyed.dense = free_head;
+			free_head = handle.index;
+		}
 	};
 }
 
@@ -29,29 +167,50 @@ namespace se::ecs
 	class entity_archetypes
 	{
 	public:
-		using value_type = std::vector<entity>;
-		using hash_type = uint32_t;
-		using hash_map = std::unordered_map<hash_type, value_type>;
-	
-	
+		using value_type = entity_table;
+
+
 	private:
-		hash_map map{};
+		/** Indexed by `index_of_archetype()`. */
+		std::vector<value_type> tables;
 
 
 	public:
-		[[msvc::forceinline]] value_type& add_unique(hash_type hash)
+		entity_archetypes()
 		{
-			return map[hash];
+			tables.resize(num_archetypes());
 		}
 
-		[[nodiscard]][[msvc::forceinline]] value_type& operator[] (hash_type hash)
+		template <typename _object_t>
+		[[msvc::forceinline]] value_type& add_unique()
 		{
-		    return map.at(hash);
+			const uint32_t index = index_of_archetype<_object_t>();
+			if (index >= tables.size())
+			{
+				// The type was registered after this manager was made.
+				tables.resize(index + 1);
+			}
+			return tables[index];
+		}
+
+		/**
+		 * @brief Retrieves the table of a type, made on first lookup.
+		 */
+		template <typename _object_t>
+		[[nodiscard]][[msvc::forceinline]] value_type& get()
+		{
+			return add_unique<_object_t>();
 		}
 
-		[[nodiscard]][[msvc::forceinline]] value_type const& operator[] (hash_type hash) const
+		/**
+		 * @brief Retrieves the table of a type, an empty one if none was made yet.
+		 */
+		template <typename _object_t>
+		[[nodiscard]][[msvc::forceinline]] value_type const& get() const
 		{
-			return map.at(hash);
+			static const value_type empty;
+			const uint32_t index = index_of_archetype<_object_t>();
+			return index < tables.size() ? tables[index] : empty;
 		}
 	};
 }
@@ -76,9 +235,49 @@ namespace se::ecs
 		{
 			// Gets compile-time reflection information of entity.
 			constexpr auto reflect = reflection<_object_t>::config();
-			constexpr auto hash = hashcode_of_type<_object_t>();
 
-			return archetypes[hash].size();
+			return archetypes.get<_object_t>().size();
+		}
+
+		/**
+		 * @brief Retrieves the handle of the entity at the given index of its components.
+		 * @details 返回给定下标的实体句柄
+		 */
+		template <typename _object_t>
+		[[nodiscard]] entity handle_of(std::size_t index) const
+		{
+			return archetypes.get<_object_t>()[index];
+		}
+
+		/**
+		 * @brief Retrieves the index of the components of an entity, or `entity_table::invalid_index` if it was destroyed.
+		 * @details 返回实体句柄对应的下标
+		 */
+		template <typename _object_t>
+		[[nodiscard]] std::size_t index_of(entity handle) const
+		{
+			return archetypes.get<_object_t>().index_of(handle);
+		}
+
+		/**
+		 * @brief Reorders entities, the i-th entity becomes the `order[i]`-th entity of before.
+		 * @details 重排实体
+		 */
+		template <typename _object_t>
+		void permute(std::span<const uint32_t> order)
+		{
+			archetypes.get<_object_t>().permute(order);
+		}
+
+		/**
+		 * @brief Moves entities into the holes of destroyed ones, then keeps the first `live` entities.
+		 *        Handles of the destroyed entities become stale.
+		 * @details 压缩实体
+		 */
+		template <typename _object_t, typename _move_t>
+		void compact(std::span<const _move_t> moves, std::size_t live)
+		{
+			archetypes.get<_object_t>().compact(moves, live);
 		}
 
 		/**
@@ -90,17 +289,9 @@ namespace se::ecs
 		{
 			// Gets compile-time reflection information of entity.
 			constexpr auto reflect = reflection<_object_t>::config();
-			constexpr uint32_t hash = hashcode_of_type<_object_t>();
-			
+
 			// Allocation.
-			std::vector<entity>& entities = archetypes.add_unique(hash);
-			std::size_t count = objects.size();
-			std::size_t index = entities.size();
-			entities.reserve(index + count);
-			while (count--)
-			{
-				entities.emplace_back(entity_archetypes::hash_type(index++));
-			}
+			archetypes.add_unique<_object_t>().generate(objects.size());
 		}
 	};
 }
@@ -1,5 +1,6 @@
 ﻿#pragma once
 
+#include <atomic>
 #include <tuple>
 #include <string_view>
 #include <type_traits>
@@ -181,6 +182,47 @@ namespace se::ecs
 
 
 
+namespace se::ecs::detail
+{
+	/** Number of archetypes, constant-initialized so that it is valid before any dynamic initialization. */
+	inline std::atomic<uint32_t> archetype_counter = 0;
+}
+
+
+
+namespace se::ecs
+{
+	/**
+	 * @brief Retrieves the slot of a type in the archetype registry, the same in every manager.
+	 *        Slots are dense and assigned once per type on first use, so finding an archetype
+	 *        is a constant offset, and two types never share a slot whatever their names hash to.
+	 * @details 返回类型的原型下标，首次使用时分配
+	 */
+	template <typename _t>
+	[[nodiscard]][[msvc::forceinline]] inline uint32_t index_of_archetype() noexcept
+	{
+		if constexpr (!std::is_same_v<_t, std::remove_cv_t<_t>>)
+		{
+			return index_of_archetype<std::remove_cv_t<_t>>();
+		}
+		else
+		{
+			static const uint32_t index = detail::archetype_counter++;
+			return index;
+		}
+	}
+
+	/**
+	 * @brief Retrieves the number of registered archetypes.
+	 */
+	[[nodiscard]] inline uint32_t num_archetypes() noexcept
+	{
+		return detail::archetype_counter.load();
+	}
+}
+
+
+
 namespace se::ecs
 {
 	/**
@@ -6,28 +6,43 @@
 #pragma once
 
 #include "Starry/Core/Public/Vector.hpp"
+#include "Starry/Core/Public/ThreadPool.hpp"
 #include "ECS/Entity.hpp"
 #include "ECS/Component.hpp"
 #include "ECS/System.hpp"
 
 #include <type_traits>
+#include <algorithm>
+#include <cassert>
 
 
 namespace se::attribute_list { static constexpr se::ecs::string_literal position = "position"; }
+namespace se::attribute_list { static constexpr se::ecs::string_literal radius = "radius"; }
 #define se_register_particle_attributes   se::ecs::register_meta_field
 #define se_make_attribute(name, pointer)  se::ecs::attribute<name, pointer>{}
 #define se_make_position(pointer)         se::ecs::attribute<se::attribute_list::position, pointer>{}
+#define se_make_radius(pointer)           se::ecs::attribute<se::attribute_list::radius, pointer>{}
 
 
 
 namespace se
 {
+	/**
+	 * @brief Stable reference to a particle, survives spatial sorting and the destruction of other particles.
+	 */
+	using particle_handle = ecs::entity;
+
+
+
 	class particle_system : public ecs::system
 	{
 	private:
-		ecs::entity_manager entity_mgr; // TODO
+		ecs::entity_manager entity_mgr;
 		ecs::component_manager component_mgr;
 
+		/** Reused by `destroy_particles()`. */
+		std::vector<ecs::compaction_move> moves;
+
 
 	public:
 		particle_system() = default;
@@ -38,6 +53,24 @@ namespace se
 			return entity_mgr.num<_user_particle_t>();
 		}
 
+		/**
+		 * @brief Retrieves the handle of the particle at `index`, e.g. an index passed to a `query_near_of` callable.
+		 */
+		template <typename _user_particle_t>
+		[[nodiscard]] particle_handle handle_of(std::size_t index) const
+		{
+			return entity_mgr.handle_of<_user_particle_t>(index);
+		}
+
+		/**
+		 * @brief Retrieves the current index of a particle, or `ecs::entity_table::invalid_index` if it was destroyed.
+		 */
+		template <typename _user_particle_t>
+		[[nodiscard]] std::size_t index_of(particle_handle handle) const
+		{
+			return entity_mgr.index_of<_user_particle_t>(handle);
+		}
+
 		template <typename _user_particle_t>
 		void generate_particle(auto&& particles)
 		{
@@ -45,11 +78,69 @@ namespace se
 			component_mgr.generate_entity_components<_user_particle_t>(std::move(particles));
 		}
 
+		/**
+		 * @brief Reorders all particles of a type, the i-th particle becomes the `order[i]`-th particle of before.
+		 */
+		template <typename _user_particle_t>
+		void permute(std::span<const uint32_t> order)
+		{
+			entity_mgr.permute<_user_particle_t>(order);
+			component_mgr.permute<_user_particle_t>(order);
+		}
+
+		/**
+		 * @brief Destroys one particle, the last particle of the type takes its place.
+		 *        An `index` out of range is a no-op in release builds.
+		 * @details 删除单个粒子（与末尾粒子交换后弹出）
+		 */
+		template <typename _user_particle_t>
+		void destroy_particle(std::size_t index)
+		{
+			const std::size_t count = num<_user_particle_t>();
+			assert(index < count && "[Starry Engine] Particle index out of range!");
+			if (index >= count)
+			{
+				return;
+			}
+
+			const std::size_t last = count - 1;
+			const ecs::compaction_move step{ (uint32_t)index, (uint32_t)last };
+			const std::span<const ecs::compaction_move> steps(&step, index != last ? 1 : 0);
+			entity_mgr.compact<_user_particle_t, ecs::compaction_move>(steps, last);
+			component_mgr.compact<_user_particle_t>(steps, last);
+		}
+
+		/**
+		 * @brief Destroys every particle whose flag in `dead` is non-zero, one flag per particle, missing flags keep the particle.
+		 *        The holes are refilled by the last live particles, so the survivors are not kept in order.
+		 * @return The number of destroyed particles.
+		 * @details 批量删除粒子
+		 */
+		template <typename _user_particle_t>
+		std::size_t destroy_particles(std::span<const uint8_t> dead)
+		{
+			const std::size_t num_before = num<_user_particle_t>();
+			const std::size_t live = ecs::plan_compaction(dead, num_before, moves);
+			if (live == num_before)
+			{
+				return 0;
+			}
+			entity_mgr.compact<_user_particle_t, ecs::compaction_move>(moves, live);
+			component_mgr.compact<_user_particle_t>(moves, live);
+			return num_before - live;
+		}
+
 		template<typename _user_particle_t, ecs::string_literal attr>
 		[[msvc::forceinline]] auto any_of() const
 		{
 			return component_mgr.any_of<_user_particle_t, attr>();
 		}
+
+		template<typename _user_particle_t, ecs::string_literal attr>
+		[[msvc::forceinline]] auto any_of()
+		{
+			return component_mgr.any_of<_user_particle_t, attr>();
+		}
 		
 		template<typename _user_particle_t, ecs::string_literal... attrs>
 		[[msvc::forceinline]] void for_each(auto&& callable)
@@ -62,5 +153,51 @@ namespace se
 		{
 			component_mgr.for_each<_user_particle_t, attrs>(std::move(callable));
 		}
+
+		/**
+		 * @brief Invokes `callable(index, attributes...)` for all particles on the engine thread pool.
+		 *        Chunks start on a cache line of every component, so that no two threads write the same line.
+		 * @details 多线程遍历粒子属性
+		 */
+		template<typename _user_particle_t, ecs::string_literal... attrs>
+		void par_for_each(auto&& callable)
+		{
+			for_each_chunk(num<_user_particle_t>(), component_mgr.line_granularity<_user_particle_t>(),
+				[this, &callable](std::size_t first, std::size_t last)
+				{
+					component_mgr.for_each_in<_user_particle_t, attrs...>(first, last, callable);
+				});
+		}
+
+		template<typename _user_particle_t, ecs::string_literal... attrs>
+		void par_for_each(auto&& callable) const
+		{
+			for_each_chunk(num<_user_particle_t>(), component_mgr.line_granularity<_user_particle_t>(),
+				[this, &callable](std::size_t first, std::size_t last)
+				{
+					component_mgr.for_each_in<_user_particle_t, attrs...>(first, last, callable);
+				});
+		}
+
+
+	private:
+		/** Splits [0, count) into a few chunks per thread, each a multiple of `granularity` long, and runs them on the engine thread pool. */
+		static void for_each_chunk(std::size_t count, std::size_t granularity, auto&& chunk_callable)
+		{
+			thread_pool& pool = thread_pool::global();
+
+			// More chunks than threads, particles in crowded cells cost more than the others.
+			constexpr std::size_t min_chunk_size = 256;
+			const std::size_t num_target_chunks = pool.num_threads() * 4;
+			std::size_t chunk_size = std::max((count + num_target_chunks - 1) / num_target_chunks, min_chunk_size);
+			chunk_size = (chunk_size + granularity - 1) / granularity * granularity;
+
+			const std::size_t num_chunks = (count + chunk_size - 1) / chunk_size;
+			pool.parallel_for(num_chunks, [count, chunk_size, &chunk_callable](std::size_t chunk)
+				{
+					const std::size_t first = chunk * chunk_size;
+					chunk_callable(first, std::min(first + chunk_size, count));
+				});
+		}
 	};
 }
\ No newline at end of file
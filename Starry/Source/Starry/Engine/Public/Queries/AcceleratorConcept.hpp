@@ -0,0 +1,60 @@
+﻿// Copyright (c) 2024 Fong ZiSing. All rights reserved.
+//
+//     AcceleratorConcept.hpp
+//
+
+#pragma once
+
+#include "Starry/Core/Public/Vector.hpp"
+
+#include <vector>
+#include <span>
+#include <concepts>
+
+
+
+namespace se
+{
+	/**
+	 * @brief Size of a spatial index, for profiling and benchmarks.
+	 * @details 加速结构的统计信息
+	 */
+	struct accelerator_stats
+	{
+		/** Number of particles indexed by the last rebuild. */
+		std::size_t num_particles;
+
+		/** Number of cells, buckets or nodes. */
+		std::size_t num_cells;
+
+		/** Heap memory held by the index, reserved capacity included. */
+		std::size_t memory_bytes;
+	};
+
+
+
+	/**
+	 * @brief Retrieves the heap memory held by some vectors.
+	 */
+	template <typename... _value_t>
+	[[nodiscard]] constexpr std::size_t capacity_bytes_of(std::vector<_value_t> const&... vectors) noexcept
+	{
+		return ((vectors.capacity() * sizeof(_value_t)) + ... + 0);
+	}
+
+
+
+	/**
+	 * @brief A spatial index over particle positions, what `basic_scene` needs of its accelerator.
+	 *        Callables are template parameters of the accelerator, so there is no virtual dispatch in the inner loop.
+	 * @details 空间加速结构概念：重建、半径查询、粒子对枚举与统计信息
+	 */
+	template <typename _accelerator_t, typename _vector_t = vec2>
+	concept accelerator = requires(_accelerator_t& accel, _accelerator_t const& const_accel, std::span<const _vector_t> positions, _vector_t position)
+	{
+		accel.rebuild(positions);
+		const_accel.query_near_of(std::size_t{}, position, float{}, [](int, float, _vector_t const) {});
+		const_accel.for_each_pair(float{}, [](int, int, float, _vector_t) {});
+		{ const_accel.stats() } -> std::same_as<accelerator_stats>;
+	};
+}
\ No newline at end of file
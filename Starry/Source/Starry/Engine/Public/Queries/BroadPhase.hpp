@@ -0,0 +1,135 @@
+﻿// Copyright (c) 2024 Fong ZiSing. All rights reserved.
+//
+//     BroadPhase.hpp
+//
+
+#pragma once
+
+#include "Starry/Core/Public/Vector.hpp"
+#include "AcceleratorConcept.hpp"
+
+#include <vector>
+#include <span>
+#include <algorithm>
+#include <cmath>
+
+
+
+namespace se
+{
+	/**
+	 * @brief A pair of overlapping particles, `a < b`.
+	 */
+	struct contact_pair
+	{
+		int32_t a;
+		int32_t b;
+		float distance_squared;
+	};
+
+
+
+	/**
+	 * @brief Broad phase of particles of different radii. Particles are put on the level whose cells are as wide as
+	 *        their diameter, levels doubling in cell size, so that a large particle only costs the cells it covers.
+	 *        Overlapping pairs are written to one contiguous buffer for the narrow phase.
+	 * @details 粗检测阶段，按粒子直径分层的网格，输出连续存储的重叠粒子对
+	 */
+	class broad_phase2d
+	{
+	private:
+		struct alignas(16) resource
+		{
+			vec2 position;
+			float radius;
+			int32_t index;
+		};
+
+		struct grid
+		{
+			int32_t begin;
+			int32_t num;
+		};
+
+		/** Cells of all levels are laid out one after another, rows of a level are contiguous in `resources`. */
+		struct level
+		{
+			float cell_size, inverse_cell_size;
+			int32_t cols, rows;
+			int32_t first_cell;
+		};
+
+		static constexpr int32_t grid_limit = 16384;
+		static constexpr int32_t max_levels = 24;
+		vec2i bounds;
+		std::vector<level> levels;
+		std::vector<grid> grids;
+		std::vector<resource> resources;
+		std::vector<int32_t> slots;
+		std::vector<int32_t> cursors;
+		std::vector<contact_pair> pairs;
+		std::vector<std::vector<contact_pair>> chunk_pairs;
+
+
+	public:
+		explicit broad_phase2d(const vec2i& scene_size) noexcept
+			: bounds(scene_size)
+		{}
+
+		[[nodiscard]] std::size_t num_levels() const noexcept
+		{
+			return levels.size();
+		}
+
+		/**
+		 * @brief Rebuilds the levels from positions and radii, both indexed by particle.
+		 *        The finest cell fits the smallest particle, but the finest level never has many more cells than particles.
+		 * @details 根据位置与半径更新索引信息
+		 */
+		void rebuild(std::span<const vec2> positions, std::span<const float> radii);
+
+		/**
+		 * @brief Finds every pair of particles closer than the sum of their radii.
+		 * @return The pairs, ordered by the cell of `a`, valid until the next call.
+		 * @details 查找所有重叠的粒子对
+		 */
+		std::span<const contact_pair> find_pairs();
+
+		/**
+		 * @brief Finds the same pairs as `find_pairs()` in the same order, on the engine thread pool.
+		 * @details 多线程查找所有重叠的粒子对
+		 */
+		std::span<const contact_pair> par_find_pairs();
+
+		/**
+		 * @brief Retrieves the size of the index.
+		 * @details 返回索引的统计信息
+		 */
+		[[nodiscard]] accelerator_stats stats() const noexcept;
+
+
+	private:
+		[[nodiscard]] static int32_t cells_along(int32_t extent, float in_cell_size) noexcept
+		{
+			return std::clamp((int32_t)std::ceil(extent / in_cell_size), 1, grid_limit);
+		}
+
+		[[nodiscard]] static int32_t cell_of(float value, float inverse_cell_size, int32_t num) noexcept
+		{
+			return std::clamp(int32_t(value * inverse_cell_size), 0, num - 1);
+		}
+
+		/** Appends the pairs of the particles at the sorted slots [first, last) with particles of the same or finer levels. */
+		void find_pairs_of(std::size_t first, std::size_t last, std::vector<contact_pair>& out) const;
+
+
+	private:
+		/** Non-copyable. */
+		broad_phase2d(const broad_phase2d&) = delete;
+		broad_phase2d& operator = (const broad_phase2d&) = delete;
+
+		/** Disable new. */
+		void* operator new (std::size_t, void*) = delete;
+		void* operator new (std::size_t) = delete;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,138 @@
+﻿// Copyright (c) 2024 Fong ZiSing. All rights reserved.
+//
+//     DoubleBufferedAccelerator.hpp
+//
+
+#pragma once
+
+#include "Starry/Core/Public/Vector.hpp"
+#include "GridAccelerator.hpp"
+
+#include <vector>
+#include <span>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+
+
+namespace se
+{
+	/**
+	 * @brief Two grids, readers query the published front one while a background thread rebuilds the back one,
+	 *        which is then published by an atomic swap. Takes the rebuild off the critical path of a frame.
+	 * @details 双缓冲网格，后台线程重建后台缓冲，完成后原子交换发布
+	 */
+	class double_buffered_accelerator
+	{
+	private:
+		struct buffer
+		{
+			grid2d_accelerator accel;
+			std::atomic<int32_t> readers = 0;
+
+			buffer(const vec2i& scene_size, grid_layout in_layout, float in_cell_size)
+				: accel(scene_size, in_layout, in_cell_size)
+			{}
+		};
+
+		buffer first;
+		buffer second;
+		std::atomic<buffer*> published;
+		std::vector<vec2> snapshot;
+
+		std::thread worker;
+		std::mutex mutex;
+		std::condition_variable wake_condition;
+		std::condition_variable done_condition;
+		bool pending = false;
+		bool stopping = false;
+		uint64_t generation = 0;
+
+
+	public:
+		/**
+		 * @brief Pins the published grid, which is not rebuilt until the guard is destroyed.
+		 *        Keep it short lived: a rebuild waits for the readers of its buffer.
+		 */
+		class read_guard
+		{
+		private:
+			buffer* pinned;
+
+			explicit read_guard(buffer* in_pinned) noexcept
+				: pinned(in_pinned)
+			{}
+
+			friend class double_buffered_accelerator;
+
+
+		public:
+			~read_guard()
+			{
+				pinned->readers.fetch_sub(1, std::memory_order_release);
+			}
+
+			grid2d_accelerator const& operator * () const noexcept
+			{
+				return pinned->accel;
+			}
+
+			grid2d_accelerator const* operator -> () const noexcept
+			{
+				return &pinned->accel;
+			}
+
+
+		private:
+			/** Non-copyable. */
+			read_guard(const read_guard&) = delete;
+			read_guard& operator = (const read_guard&) = delete;
+		};
+
+
+	public:
+		double_buffered_accelerator(const vec2i& scene_size, grid_layout in_layout = grid_layout::linked_list, float in_cell_size = grid2d_accelerator::default_cell_size);
+
+		~double_buffered_accelerator();
+
+		/**
+		 * @brief Pins the published grid for reading, never blocks.
+		 * @details 获取当前发布的网格用于查询
+		 */
+		[[nodiscard]] read_guard read() const noexcept;
+
+		/**
+		 * @brief Copies `positions` and rebuilds the back grid from them on the background thread, then publishes it.
+		 *        Only blocks while the previous rebuild is still running.
+		 * @details 异步重建后台网格
+		 */
+		void begin_rebuild(std::span<const vec2> positions);
+
+		/**
+		 * @brief Blocks until the pending rebuild, if any, is published.
+		 * @details 等待后台重建完成
+		 */
+		void wait();
+
+		/**
+		 * @brief Retrieves the number of rebuilds published so far.
+		 */
+		[[nodiscard]] uint64_t num_published();
+
+
+	private:
+		void worker_loop();
+
+
+	private:
+		/** Non-copyable. */
+		double_buffered_accelerator(const double_buffered_accelerator&) = delete;
+		double_buffered_accelerator& operator = (const double_buffered_accelerator&) = delete;
+
+		/** Disable new. */
+		void* operator new (std::size_t, void*) = delete;
+		void* operator new (std::size_t) = delete;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,342 @@
+﻿// Copyright (c) 2024 Fong ZiSing. All rights reserved.
+//
+//     Grid3DAccelerator.hpp
+//
+
+#pragma once
+
+#include "Starry/Core/Public/Vector.hpp"
+#include "AcceleratorConcept.hpp"
+
+#include <vector>
+#include <span>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+
+
+
+namespace se
+{
+	/**
+	 * @brief Uniform 3D grid, particles are sorted by cell so that the cells of a row are one contiguous range,
+	 *        a query streams 9 ranges instead of visiting 27 cells.
+	 * @details 三维均匀网格，按网格计数排序
+	 */
+	class grid3d_accelerator
+	{
+	private:
+		/** One aligned `float4` per particle: (x, y, z, index). */
+		struct alignas(16) resource
+		{
+			float x, y, z;
+			int32_t index;
+
+			[[nodiscard]] vec3 position() const noexcept
+			{
+				return vec3{ x, y, z };
+			}
+		};
+
+		struct grid
+		{
+			int32_t begin;
+			int32_t num;
+		};
+
+		static constexpr int32_t grid_limit = 1024;
+		vec3i bounds;
+		float cell_size, inverse_cell_size;
+		int32_t cols, rows, layers;
+		std::vector<grid> grids;
+		std::vector<resource> resources;
+		std::vector<int32_t> slots;
+		std::vector<int32_t> histograms;
+		bool indexed = false;
+
+
+	public:
+		static constexpr float default_cell_size = 8.f;
+
+		/**
+		 * @param in_cell_size Width of a cell, any positive value. A cell as wide as the most frequent query radius
+		 *                     keeps those queries on 3x3x3 cells.
+		 */
+		grid3d_accelerator(const vec3i& scene_size, float in_cell_size = default_cell_size)
+			: bounds(scene_size)
+			, cell_size(std::max(in_cell_size, 1e-3f))
+			, inverse_cell_size(1.f / cell_size)
+			, cols(cells_along(scene_size.x, cell_size))
+			, rows(cells_along(scene_size.y, cell_size))
+			, layers(cells_along(scene_size.z, cell_size))
+			, grids(std::size_t(cols) * rows * layers, grid{})
+		{}
+
+		[[nodiscard]] float get_cell_size() const noexcept
+		{
+			return cell_size;
+		}
+
+		/**
+		 * @brief Changes the width of a cell, takes effect on the next rebuild.
+		 * @details 修改网格大小，下一次更新索引时生效
+		 */
+		void set_cell_size(float in_cell_size)
+		{
+			cell_size = std::max(in_cell_size, 1e-3f);
+			inverse_cell_size = 1.f / cell_size;
+			cols = cells_along(bounds.x, cell_size);
+			rows = cells_along(bounds.y, cell_size);
+			layers = cells_along(bounds.z, cell_size);
+			grids.assign(std::size_t(cols) * rows * layers, grid{});
+			indexed = false;
+		}
+
+		/**
+		 * @brief rebuild grid's indexing information.
+		 * @details 更新索引信息
+		 */
+		void rebuild(std::span<const vec3> positions) noexcept;
+
+		/**
+		 * @brief rebuild grid's indexing information on the engine thread pool,
+		 *        the result is identical to `rebuild()`.
+		 * @details 多线程更新索引信息
+		 */
+		void par_rebuild(std::span<const vec3> positions);
+
+		/**
+		 * @brief Updates grid's indexing information, only refreshes the cached positions if no particle crossed a cell,
+		 *        otherwise resorts. Falls back to `rebuild()` if the particle count changed.
+		 * @details 增量更新索引信息
+		 */
+		void update(std::span<const vec3> positions) noexcept;
+
+		/**
+		 * @brief Invokes `callable(index, distance_squared, position)` for every particle within `radius` of `position`,
+		 *        the particle at `index` itself is skipped.
+		 * @details 查询邻近粒子
+		 */
+		template <typename _callable_t>
+		void query_near_of(std::size_t index, vec3 position, float radius, _callable_t&& callable) const;
+
+		/**
+		 * @brief Type-erased version of the above, prefer passing the callable directly in hot loops.
+		 */
+		void query_near_of(std::size_t index, vec3 position, float radius, std::function<void(int, float, vec3 const)>&& callable) const;
+
+		/**
+		 * @brief Retrieves the size of the index.
+		 * @details 返回索引的统计信息
+		 */
+		[[nodiscard]] accelerator_stats stats() const noexcept;
+
+		/**
+		 * @brief Invokes `callable(index_a, index_b, distance_squared, position_b - position_a)` exactly once
+		 *        for every unordered pair of particles within `radius` of each other.
+		 * @details 枚举所有邻近粒子对（每对仅一次）
+		 */
+		template <typename _callable_t>
+		void for_each_pair(float radius, _callable_t&& callable) const;
+
+
+	private:
+		/** Half-open box of cells [min, max). */
+		struct cell_box
+		{
+			int32_t min_x, min_y, min_z;
+			int32_t max_x, max_y, max_z;
+		};
+
+		[[nodiscard]] static int32_t cells_along(int32_t extent, float in_cell_size) noexcept
+		{
+			return std::clamp((int32_t)std::ceil(extent / in_cell_size), 1, grid_limit);
+		}
+
+		[[nodiscard]] int32_t slot_of(vec3 position) const noexcept
+		{
+			int32_t clamped_x = std::clamp(int32_t(position.x * inverse_cell_size), 0, cols - 1);
+			int32_t clamped_y = std::clamp(int32_t(position.y * inverse_cell_size), 0, rows - 1);
+			int32_t clamped_z = std::clamp(int32_t(position.z * inverse_cell_size), 0, layers - 1);
+			return clamped_x + (clamped_y + clamped_z * rows) * cols;
+		}
+
+		/** Retrieves the cells of the row (y, z). */
+		[[nodiscard]] const grid* row_of(int32_t y, int32_t z) const noexcept
+		{
+			return grids.data() + std::size_t(y + z * rows) * cols;
+		}
+
+		/** Number of cells a query of `radius` has to reach on each side. */
+		[[nodiscard]] int32_t grid_radius_of(float radius) const noexcept
+		{
+			return (int32_t)std::ceil(radius * inverse_cell_size);
+		}
+
+		[[nodiscard]] cell_box cells_within(vec3 position, float radius) const noexcept
+		{
+			const int32_t grid_radius = grid_radius_of(radius);
+
+			// Particles out of the scene are clamped into the border cells, so is the center of the query.
+			const int32_t slot_x = std::clamp(int32_t(position.x * inverse_cell_size), 0, cols - 1);
+			const int32_t slot_y = std::clamp(int32_t(position.y * inverse_cell_size), 0, rows - 1);
+			const int32_t slot_z = std::clamp(int32_t(position.z * inverse_cell_size), 0, layers - 1);
+			return cell_box
+			{
+				std::clamp(slot_x - grid_radius, 0, cols),
+				std::clamp(slot_y - grid_radius, 0, rows),
+				std::clamp(slot_z - grid_radius, 0, layers),
+				std::clamp(slot_x + grid_radius + 1, 0, cols),
+				std::clamp(slot_y + grid_radius + 1, 0, rows),
+				std::clamp(slot_z + grid_radius + 1, 0, layers),
+			};
+		}
+
+		template <typename _callable_t>
+		void for_each_slot(std::span<const vec3> positions, _callable_t&& callable) const noexcept;
+
+		void sort_by_slots(std::span<const vec3> positions) noexcept;
+
+
+	private:
+		/** Non-copyable. */
+		grid3d_accelerator(const grid3d_accelerator&) = delete;
+		grid3d_accelerator& operator = (const grid3d_accelerator&) = delete;
+
+		/** Disable new. */
+		void* operator new (std::size_t, void*) = delete;
+		void* operator new (std::size_t) = delete;
+	};
+}
+
+
+
+namespace se
+{
+	template <typename _callable_t>
+	[[msvc::forceinline]] void grid3d_accelerator::query_near_of(std::size_t index, vec3 position, float radius, _callable_t&& callable) const
+	{
+		if (radius <= 0) [[unlikely]]
+		{
+			return;
+		}
+
+		const float radius_squared = math::square(radius);
+		const cell_box box = cells_within(position, radius);
+		if (box.min_x >= box.max_x || box.min_y >= box.max_y || box.min_z >= box.max_z)
+		{
+			return;
+		}
+
+		const resource* res_ptr = resources.data();
+		for (int32_t k = box.min_z; k < box.max_z; ++k)
+		{
+			for (int32_t j = box.min_y; j < box.max_y; ++j)
+			{
+				// Adjacent cells of a row are adjacent in `resources`, streams them as one range.
+				const grid* row = row_of(j, k);
+				const resource* first = res_ptr + row[box.min_x].begin;
+				const resource* last = res_ptr + row[box.max_x - 1].begin + row[box.max_x - 1].num;
+				for (; first != last; ++first)
+				{
+					if (index != (std::size_t)first->index) // ignore self.
+					{
+						const vec3 found_position = first->position();
+						if (float distance_squared = position.distance_squared(found_position); distance_squared < radius_squared)
+						{
+							callable(first->index, distance_squared, found_position);
+						}
+					}
+				}
+			}
+		}
+	}
+
+
+
+	template <typename _callable_t>
+	void grid3d_accelerator::for_each_pair(float radius, _callable_t&& callable) const
+	{
+		if (radius <= 0) [[unlikely]]
+		{
+			return;
+		}
+
+		const float radius_squared = math::square(radius);
+		const int32_t grid_radius = grid_radius_of(radius);
+		const resource* res_ptr = resources.data();
+
+		const auto visit = [&](resource const& a, resource const& b)
+			{
+				const vec3 delta = b.position() - a.position();
+				if (float distance_squared = delta.length_squared(); distance_squared < radius_squared)
+				{
+					callable(a.index, b.index, distance_squared, delta);
+				}
+			};
+
+		// Half-shell stencil: a cell is paired with itself, the cells on its right in the same row,
+		// the next `grid_radius` rows of the same layer, and the next `grid_radius` layers.
+		for (int32_t z = 0; z < layers; ++z)
+		{
+			for (int32_t y = 0; y < rows; ++y)
+			{
+				const grid* curr_row = row_of(y, z);
+				for (int32_t x = 0; x < cols; ++x)
+				{
+					const grid& curr = curr_row[x];
+					if (curr.num == 0)
+					{
+						continue;
+					}
+
+					const resource* first = res_ptr + curr.begin;
+					const resource* last = first + curr.num;
+					const int32_t min_x = std::max(x - grid_radius, 0);
+					const int32_t max_x = std::min(x + grid_radius + 1, cols);
+					const int32_t min_y = std::max(y - grid_radius, 0);
+					const int32_t max_y = std::min(y + grid_radius + 1, rows);
+					const int32_t max_z = std::min(z + grid_radius + 1, layers);
+
+					const auto visit_range = [&](const grid* row, int32_t from_x, int32_t to_x)
+						{
+							if (from_x >= to_x)
+							{
+								return;
+							}
+							const resource* other_first = res_ptr + row[from_x].begin;
+							const resource* other_last = res_ptr + row[to_x - 1].begin + row[to_x - 1].num;
+							for (const resource* a = first; a != last; ++a)
+							{
+								for (const resource* b = other_first; b != other_last; ++b)
+								{
+									[[msvc::forceinline_calls]] visit(*a, *b);
+								}
+							}
+						};
+
+					for (const resource* a = first; a != last; ++a)
+					{
+						for (const resource* b = a + 1; b != last; ++b)
+						{
+							[[msvc::forceinline_calls]] visit(*a, *b);
+						}
+					}
+
+					visit_range(curr_row, x + 1, max_x);
+					for (int32_t j = y + 1; j < max_y; ++j)
+					{
+						visit_range(row_of(j, z), min_x, max_x);
+					}
+					for (int32_t k = z + 1; k < max_z; ++k)
+					{
+						for (int32_t j = min_y; j < max_y; ++j)
+						{
+							visit_range(row_of(j, k), min_x, max_x);
+						}
+					}
+				}
+			}
+		}
+	}
+}
\ No newline at end of file
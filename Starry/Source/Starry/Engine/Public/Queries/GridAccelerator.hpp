@@ -6,16 +6,89 @@
 #pragma once
 
 #include "Starry/Core/Public/Vector.hpp"
+#include "AcceleratorConcept.hpp"
 
 #include <vector>
 #include <span>
 #include <functional>
 #include <algorithm>
+#include <cmath>
+#include <limits>
 
 
 
 namespace se
 {
+	/**
+	 * @brief Memory layout of the particles indexed by a grid.
+	 * @details 网格索引的内存布局
+	 */
+	enum class grid_layout : uint8_t
+	{
+		/** Each cell chains its particles through `resource::next`. */
+		linked_list,
+
+		/** Particles are sorted by cell, each cell owns a contiguous range of resources. */
+		counting_sort,
+
+		/**
+		 * Particles are sorted by cell into separate x, y and index arrays, without `resource`.
+		 * Halves the memory traffic and lets queries test four candidates per load, worth it once `resources` outgrows L2.
+		 */
+		sorted_arrays,
+	};
+
+
+
+	/**
+	 * @brief How a grid treats the particles out of the scene.
+	 * @details 网格的边界条件
+	 */
+	enum class grid_boundary : uint8_t
+	{
+		/** Out-of-range coordinates are clamped into the border cells. */
+		clamp,
+
+		/** The scene is a torus, cells wrap around and distances follow the minimum image convention. */
+		periodic,
+	};
+
+
+
+	/**
+	 * @brief An entry of a nearest neighbor query.
+	 */
+	struct nearest_neighbor
+	{
+		int32_t index;
+		float distance_squared;
+	};
+
+
+
+	/**
+	 * @brief An entry of a batched neighbor query.
+	 */
+	struct probe_hit
+	{
+		int32_t probe;
+		int32_t index;
+		float distance_squared;
+	};
+
+
+
+	/**
+	 * @brief Result of a raycast, `index` is -1 if nothing was hit.
+	 */
+	struct raycast_hit
+	{
+		int32_t index;
+		float distance;
+	};
+
+
+
 	class grid2d_accelerator
 	{
 	private:
@@ -23,29 +96,135 @@ namespace se
 		{
 			vec2 position;
 			int32_t next;
-			int32_t reserved;
+			int32_t index;
 		};
 
 		struct alignas(16) grid
 		{
 			std::size_t num;
 			int32_t head;
-			int32_t reserved;
+			int32_t begin;
 		};
 		
-		static constexpr int32_t grid_bits = 3;
 		static constexpr int32_t grid_limit = 16384;
+		vec2i bounds;
+		float cell_size, inverse_cell_size;
 		int32_t cols, rows;
+		grid_layout layout;
+		grid_boundary boundary = grid_boundary::clamp;
+		vec2 period;
+		vec2 inverse_period;
+		int32_t periodic_slack = 0;
 		std::vector<grid> grids;
 		std::vector<resource> resources;
+		std::vector<float> sorted_xs;
+		std::vector<float> sorted_ys;
+		std::vector<int32_t> sorted_indices;
+		std::vector<int32_t> slots;
+		std::vector<int32_t> movers;
+		std::vector<int32_t> histograms;
+		std::vector<int32_t> chain_ends;
+		bool indexed = false;
 
 
 	public:
-		grid2d_accelerator(const vec2i& scene_size)
-			: cols(std::min(grid_limit, (scene_size.x + (1 << grid_bits) - 1) >> grid_bits))
-			, rows(std::min(grid_limit, (scene_size.y + (1 << grid_bits) - 1) >> grid_bits))
+		static constexpr float default_cell_size = 8.f;
+
+		/**
+		 * @param in_cell_size Width of a cell, any positive value. A cell as wide as the most frequent query radius
+		 *                     keeps those queries on 3x3 cells.
+		 */
+		grid2d_accelerator(const vec2i& scene_size, grid_layout in_layout = grid_layout::linked_list, float in_cell_size = default_cell_size)
+			: bounds(scene_size)
+			, cell_size(std::max(in_cell_size, 1e-3f))
+			, inverse_cell_size(1.f / cell_size)
+			, cols(cells_along(scene_size.x, cell_size))
+			, rows(cells_along(scene_size.y, cell_size))
+			, layout(in_layout)
+			, period(float(std::max(scene_size.x, 1)), float(std::max(scene_size.y, 1)))
+			, inverse_period(1.f / period.x, 1.f / period.y)
 			, grids(cols * rows, grid{})
-		{}
+		{
+			update_periodic_slack();
+		}
+
+		[[nodiscard]] float get_cell_size() const noexcept
+		{
+			return cell_size;
+		}
+
+		/**
+		 * @brief Changes the width of a cell, takes effect on the next rebuild.
+		 * @details 修改网格大小，下一次更新索引时生效
+		 */
+		void set_cell_size(float in_cell_size)
+		{
+			cell_size = std::max(in_cell_size, 1e-3f);
+			inverse_cell_size = 1.f / cell_size;
+			cols = cells_along(bounds.x, cell_size);
+			rows = cells_along(bounds.y, cell_size);
+			grids.assign(cols * rows, grid{});
+			indexed = false;
+			update_periodic_slack();
+		}
+
+		[[nodiscard]] grid_layout memory_layout() const noexcept
+		{
+			return layout;
+		}
+
+		/**
+		 * @brief Changes the memory layout, takes effect on the next rebuild, the grid is empty until then.
+		 * @details 切换内存布局，下一次更新索引时生效
+		 */
+		void set_memory_layout(grid_layout in_layout) noexcept
+		{
+			if (layout != in_layout)
+			{
+				std::fill(grids.begin(), grids.end(), grid{});
+				indexed = false;
+			}
+			layout = in_layout;
+		}
+
+		[[nodiscard]] grid_boundary get_boundary() const noexcept
+		{
+			return boundary;
+		}
+
+		/**
+		 * @brief Changes the boundary condition, takes effect on the next rebuild, the grid is empty until then.
+		 *        With `grid_boundary::periodic`, a cell size dividing the scene size saves one extra ring of cells per query.
+		 * @details 切换边界条件，下一次更新索引时生效
+		 */
+		void set_boundary(grid_boundary in_boundary) noexcept
+		{
+			if (boundary != in_boundary)
+			{
+				std::fill(grids.begin(), grids.end(), grid{});
+				indexed = false;
+			}
+			boundary = in_boundary;
+		}
+
+		/**
+		 * @brief Folds a displacement to its nearest image on the torus, meaningful with `grid_boundary::periodic` only.
+		 * @details 返回位移的最小镜像
+		 */
+		[[nodiscard]] vec2 minimum_image(vec2 delta) const noexcept
+		{
+			return vec2
+			{
+				delta.x - period.x * std::round(delta.x * inverse_period.x),
+				delta.y - period.y * std::round(delta.y * inverse_period.y),
+			};
+		}
+
+		/**
+		 * @brief Wraps positions into the scene, [0, scene_size) on each axis, two positions per SIMD operation.
+		 * @details 将坐标回绕到场景范围内
+		 */
+		void wrap(std::span<vec2> positions) const noexcept;
 
 		/**
 		 * @brief rebuild grid's indexing information.
@@ -53,8 +232,342 @@ namespace se
 		 */
 		void rebuild(std::span<const vec2> positions) noexcept;
 
+		/**
+		 * @brief rebuild grid's indexing information on the engine thread pool,
+		 *        the result is identical to `rebuild()`.
+		 * @details 多线程更新索引信息
+		 */
+		void par_rebuild(std::span<const vec2> positions);
+
+		/**
+		 * @brief Updates grid's indexing information incrementally, only the particles that crossed a cell are relinked,
+		 *        the others just refresh their cached position. Falls back to `rebuild()` if the particle count changed.
+		 * @details 增量更新索引信息，仅重新插入跨越网格的粒子
+		 * @note With `grid_layout::counting_sort` and `grid_layout::sorted_arrays`, any crossing resorts all particles.
+		 */
+		void update(std::span<const vec2> positions) noexcept;
+
+		/**
+		 * @brief Invokes `callable(index, distance_squared, position)` for every particle within `radius` of `position`,
+		 *        the particle at `index` itself is skipped.
+		 *        With `grid_boundary::periodic`, the reported position is the nearest image of the particle,
+		 *        so that `found_position - position` is the minimum image displacement.
+		 * @details 查询邻近粒子
+		 */
+		template <typename _callable_t>
+		void query_near_of(std::size_t index, vec2 position, float radius, _callable_t&& callable) const;
+
+		/**
+		 * @brief Type-erased version of the above, prefer passing the callable directly in hot loops.
+		 */
 		void query_near_of(std::size_t index, vec2 position, float radius, std::function<void(int, float, vec2 const)>&& callable) const;
 
+		/**
+		 * @brief Retrieves the size of the index.
+		 * @details 返回索引的统计信息
+		 */
+		[[nodiscard]] accelerator_stats stats() const noexcept;
+
+		/**
+		 * @brief Finds the particles within `radius` of every probe, testing candidates four at a time.
+		 *        Hits are compacted and delivered to `callable` in blocks, in probe order.
+		 * @details 批量查询多个探测点的邻近粒子，命中结果分块回调
+		 */
+		void query_near_of_batch(std::span<const vec2> probes, float radius, std::function<void(std::span<const probe_hit>)> const& callable) const;
+
+		/**
+		 * @brief Invokes `callable(index_a, index_b, distance_squared, position_b - position_a)` exactly once
+		 *        for every unordered pair of particles within `radius` of each other.
+		 *        With `grid_boundary::periodic`, the displacement is the minimum image one.
+		 * @details 枚举所有邻近粒子对（每对仅一次），可用于对称地施加作用力
+		 */
+		template <typename _callable_t>
+		void for_each_pair(float radius, _callable_t&& callable) const;
+
+		/**
+		 * @brief Finds the `k` particles nearest to `position`, the particle at `index` itself is skipped.
+		 *        Cells are searched ring by ring outwards, until no unsearched cell can be nearer than the k-th found.
+		 * @param out Receives the neighbors sorted by distance, also used as the heap, must hold at least `k` entries.
+		 * @return The number of neighbors found, less than `k` only if there are not enough particles.
+		 * @details 查询最近的 k 个粒子
+		 * @note Ignores `grid_boundary::periodic`, the scene is searched as if clamped.
+		 */
+		std::size_t query_k_nearest(std::size_t index, vec2 position, std::size_t k, std::span<nearest_neighbor> out) const noexcept;
+
+		/**
+		 * @brief Finds the `k` nearest particles of every indexed particle.
+		 * @param out Receives the neighbors of particle i in [i * k, i * k + k), sorted by distance,
+		 *            missing entries have index -1. Must hold at least `k * num_particles` entries.
+		 * @details 批量查询所有粒子的最近 k 个粒子
+		 * @note Ignores `grid_boundary::periodic`, the scene is searched as if clamped.
+		 */
+		void query_k_nearest_all(std::size_t k, std::span<nearest_neighbor> out) const noexcept;
+
+		/**
+		 * @brief Invokes `callable(index, position)` for every particle inside the box [lower, upper], bounds included.
+		 * @details 查询矩形范围内的粒子
+		 * @note Ignores `grid_boundary::periodic`, the scene is searched as if clamped.
+		 */
+		template <typename _callable_t>
+		void query_aabb(vec2 lower, vec2 upper, _callable_t&& callable) const;
+
+		/**
+		 * @brief Invokes `callable(index, distance_squared, position)` for every particle within `radius` of the segment [from, to],
+		 *        the particle at `index` itself is skipped. Only the cells along the segment are visited.
+		 * @details 查询线段附近的粒子
+		 * @note Ignores `grid_boundary::periodic`, the scene is searched as if clamped.
+		 */
+		template <typename _callable_t>
+		void query_segment(std::size_t index, vec2 from, vec2 to, float radius, _callable_t&& callable) const;
+
+		/**
+		 * @brief Finds the first particle hit by a ray, particles are discs of `radius`, the particle at `index` itself is skipped.
+		 *        Cells are walked from the origin and the walk stops as soon as no farther cell can hold a nearer hit.
+		 * @param direction Direction of the ray, need not be normalized.
+		 * @details 射线检测，返回最先命中的粒子
+		 * @note Ignores `grid_boundary::periodic`, the scene is searched as if clamped.
+		 */
+		[[nodiscard]] raycast_hit raycast_first(std::size_t index, vec2 origin, vec2 direction, float max_distance, float radius) const noexcept;
+
+
+	private:
+		/** Half-open box of cells [min, max). */
+		struct cell_box
+		{
+			int32_t min_x, min_y;
+			int32_t max_x, max_y;
+		};
+
+		[[nodiscard]] static int32_t cells_along(int32_t extent, float in_cell_size) noexcept
+		{
+			return std::clamp((int32_t)std::ceil(extent / in_cell_size), 1, grid_limit);
+		}
+
+		/** Cells smaller than the others at the seam may put neighbors one more cell away. */
+		void update_periodic_slack() noexcept
+		{
+			periodic_slack = (cols * cell_size != period.x || rows * cell_size != period.y) ? 1 : 0;
+		}
+
+		[[nodiscard]] static int32_t wrap_cell(int32_t cell, int32_t num) noexcept
+		{
+			return ((cell % num) + num) % num;
+		}
+
+		/** x - period * floor(x / period), folded back once more when x / period rounds across an integer. */
+		[[nodiscard]] static float wrap_of(float value, float in_period, float in_inverse_period) noexcept
+		{
+			float wrapped = value - in_period * std::floor(value * in_inverse_period);
+			if (wrapped >= in_period)
+			{
+				wrapped -= in_period;
+			}
+			else if (wrapped < 0)
+			{
+				wrapped += in_period;
+			}
+			return wrapped;
+		}
+
+		[[nodiscard]] vec2 wrap_of(vec2 position) const noexcept
+		{
+			return vec2
+			{
+				wrap_of(position.x, period.x, inverse_period.x),
+				wrap_of(position.y, period.y, inverse_period.y),
+			};
+		}
+
+		[[nodiscard]] int32_t slot_of(vec2 position) const noexcept
+		{
+			if (boundary == grid_boundary::periodic)
+			{
+				position = wrap_of(position);
+			}
+			int32_t integer_x = int32_t(position.x * inverse_cell_size);
+			int32_t integer_y = int32_t(position.y * inverse_cell_size);
+			int32_t clamped_x = std::clamp(integer_x, 0, cols - 1);
+			int32_t clamped_y = std::clamp(integer_y, 0, rows - 1);
+			return clamped_x + (clamped_y * cols);
+		}
+
+		/** Number of candidates tested per call of `filter_sorted()`. */
+		static constexpr int32_t sorted_block_size = 64;
+
+		/** Padding of the sorted arrays, so that a vector load may start at any particle. */
+		static constexpr std::size_t sorted_padding = 3;
+
+		[[nodiscard]] resource sorted_at(int32_t slot) const noexcept
+		{
+			return resource{ vec2{ sorted_xs[slot], sorted_ys[slot] }, 0, sorted_indices[slot] };
+		}
+
+		/**
+		 * Tests the sorted particles [first, last) against a circle, at most `sorted_block_size` of them.
+		 * Writes the slot and the distance of each hit, returns the number of hits.
+		 */
+		std::size_t filter_sorted(int32_t first, int32_t last, vec2 position, float radius_squared, int32_t* hit_slots, float* hit_distances) const noexcept;
+
+		template <typename _callable_t>
+		[[msvc::forceinline]] void for_each_in_cell(grid const& cell, _callable_t&& callable) const
+		{
+			if (layout == grid_layout::sorted_arrays)
+			{
+				for (int32_t slot = cell.begin; slot < cell.begin + (int32_t)cell.num; ++slot)
+				{
+					callable(sorted_at(slot));
+				}
+			}
+			else if (layout == grid_layout::counting_sort)
+			{
+				const resource* first = resources.data() + cell.begin;
+				const resource* last = first + cell.num;
+				for (; first != last; ++first)
+				{
+					callable(*first);
+				}
+			}
+			else
+			{
+				for (int32_t head = cell.head; head; head = resources[head - 1].next)
+				{
+					callable(resources[head - 1]);
+				}
+			}
+		}
+
+		/** Invokes `callable(a, b)` once for every unordered pair of particles of a cell. */
+		template <typename _callable_t>
+		[[msvc::forceinline]] void for_each_pair_in_cell(grid const& cell, _callable_t&& callable) const
+		{
+			const int32_t last = cell.begin + (int32_t)cell.num;
+			if (layout == grid_layout::sorted_arrays)
+			{
+				for (int32_t a = cell.begin; a < last; ++a)
+				{
+					const resource res_a = sorted_at(a);
+					for (int32_t b = a + 1; b < last; ++b)
+					{
+						callable(res_a, sorted_at(b));
+					}
+				}
+			}
+			else if (layout == grid_layout::counting_sort)
+			{
+				const resource* res_ptr = resources.data();
+				for (int32_t a = cell.begin; a < last; ++a)
+				{
+					for (int32_t b = a + 1; b < last; ++b)
+					{
+						callable(res_ptr[a], res_ptr[b]);
+					}
+				}
+			}
+			else
+			{
+				const resource* res_ptr = resources.data();
+				for (int32_t a = cell.head; a; a = res_ptr[a - 1].next)
+				{
+					for (int32_t b = res_ptr[a - 1].next; b; b = res_ptr[b - 1].next)
+					{
+						callable(res_ptr[a - 1], res_ptr[b - 1]);
+					}
+				}
+			}
+		}
+
+		/** Visits the cells [min_x, max_x) of row `y`. */
+		template <typename _callable_t>
+		[[msvc::forceinline]] void for_each_in_row(int32_t y, int32_t min_x, int32_t max_x, _callable_t&& callable) const
+		{
+			const grid* row = grids.data() + (y * cols);
+			if (layout == grid_layout::sorted_arrays)
+			{
+				const int32_t last = row[max_x - 1].begin + (int32_t)row[max_x - 1].num;
+				for (int32_t slot = row[min_x].begin; slot < last; ++slot)
+				{
+					callable(sorted_at(slot));
+				}
+			}
+			else if (layout == grid_layout::counting_sort)
+			{
+				// Adjacent cells of a row are adjacent in `resources`.
+				const resource* first = resources.data() + row[min_x].begin;
+				const resource* last = resources.data() + row[max_x - 1].begin + row[max_x - 1].num;
+				for (; first != last; ++first)
+				{
+					callable(*first);
+				}
+			}
+			else
+			{
+				for (int32_t x = min_x; x < max_x; ++x)
+				{
+					for_each_in_cell(row[x], callable);
+				}
+			}
+		}
+
+		/** Number of cells a query of `radius` has to reach on each side. */
+		[[nodiscard]] int32_t grid_radius_of(float radius) const noexcept
+		{
+			return (int32_t)std::ceil(radius * inverse_cell_size);
+		}
+
+		[[nodiscard]] cell_box cells_within(vec2 position, float radius) const noexcept
+		{
+			const int32_t grid_radius = grid_radius_of(radius);
+
+			// Particles out of the scene are clamped into the border cells, so is the center of the query.
+			const int32_t slot_x = std::clamp(int32_t(position.x * inverse_cell_size), 0, cols - 1);
+			const int32_t slot_y = std::clamp(int32_t(position.y * inverse_cell_size), 0, rows - 1);
+			return cell_box
+			{
+				std::clamp(slot_x - grid_radius, 0, cols),
+				std::clamp(slot_y - grid_radius, 0, rows),
+				std::clamp(slot_x + grid_radius + 1, 0, cols),
+				std::clamp(slot_y + grid_radius + 1, 0, rows),
+			};
+		}
+
+		/**
+		 * Walks the cells within `radius` of the segment [from, to] strip by strip along its major axis, from `from` to `to`.
+		 * `enter(t)` is called before each strip with the smallest segment parameter a particle of the strip can be reached at,
+		 * returning false stops the walk. `visit(resource)` is called for every particle of the strip.
+		 */
+		template <typename _enter_t, typename _visit_t>
+		void walk_segment(vec2 from, vec2 to, float radius, _enter_t&& enter, _visit_t&& visit) const;
+
+		template <typename _callable_t>
+		void query_near_of_periodic(std::size_t index, vec2 position, float radius, _callable_t&& callable) const;
+
+		template <typename _callable_t>
+		void for_each_pair_periodic(float radius, _callable_t&& callable) const;
+
+		template <typename _callable_t>
+		void for_each_slot(std::span<const vec2> positions, _callable_t&& callable) const noexcept;
+
+		/** Sizes the storage of the current layout for `num` particles, releases the other one. */
+		void resize_storage(std::size_t num) noexcept;
+
+		void rebuild_linked_list(std::span<const vec2> positions) noexcept;
+
+		void rebuild_counting_sort(std::span<const vec2> positions) noexcept;
+
+		/** Invokes `callable(scatter)`, `scatter(slot, index)` stores the particle at `index` to `slot` of the current layout. */
+		template <typename _callable_t>
+		void with_scatter_of(std::span<const vec2> positions, _callable_t&& callable);
+
+		void sort_by_slots(std::span<const vec2> positions) noexcept;
+
+		void update_linked_list(std::span<const vec2> positions) noexcept;
+
+		void update_counting_sort(std::span<const vec2> positions) noexcept;
+
+		void par_rebuild_linked_list(std::span<const vec2> positions, std::size_t num_chunks, std::size_t chunk_size);
+
+		void par_rebuild_counting_sort(std::span<const vec2> positions, std::size_t chunk_size);
+
 
 	private:
 		/** Non-copyable. */
@@ -65,4 +578,479 @@ namespace se
 		void* operator new (std::size_t, void*) = delete;
 		void* operator new (std::size_t) = delete;
 	};
+}
+
+
+
+namespace se
+{
+	template <typename _callable_t>
+	[[msvc::forceinline]] void grid2d_accelerator::query_near_of(std::size_t index, vec2 position, float radius, _callable_t&& callable) const
+	{
+		if (radius <= 0) [[unlikely]]
+		{
+			return;
+		}
+
+		if (boundary == grid_boundary::periodic)
+		{
+			query_near_of_periodic(index, position, radius, callable);
+			return;
+		}
+
+		const float radius_squared = math::square(radius);
+		const cell_box box = cells_within(position, radius);
+		if (box.min_x >= box.max_x || box.min_y >= box.max_y)
+		{
+			return;
+		}
+
+		const resource* res_ptr = resources.data();
+
+		const auto visit = [&](resource const& res)
+			{
+				if (index != (std::size_t)res.index) // ignore self.
+				{
+					vec2 const& found_position = res.position;
+					if (float distance_squared = position.distance_squared(found_position); distance_squared < radius_squared)
+					{
+						callable(res.index, distance_squared, found_position);
+					}
+				}
+			};
+
+		for (int32_t j = box.min_y; j < box.max_y; ++j)
+		{
+			const grid* row = grids.data() + (j * cols);
+
+			if (layout == grid_layout::sorted_arrays)
+			{
+				// Filters the row in blocks, four candidates per load, then reports the hits.
+				int32_t hit_slots[sorted_block_size];
+				float hit_distances[sorted_block_size];
+				const int32_t last = row[box.max_x - 1].begin + (int32_t)row[box.max_x - 1].num;
+				for (int32_t first = row[box.min_x].begin; first < last; first += sorted_block_size)
+				{
+					const std::size_t num_hits = filter_sorted(first, std::min(first + sorted_block_size, last), position, radius_squared, hit_slots, hit_distances);
+					for (std::size_t hit = 0; hit < num_hits; ++hit)
+					{
+						const int32_t slot = hit_slots[hit];
+						if (index != (std::size_t)sorted_indices[slot]) // ignore self.
+						{
+							callable(sorted_indices[slot], hit_distances[hit], vec2{ sorted_xs[slot], sorted_ys[slot] });
+						}
+					}
+				}
+			}
+			else if (layout == grid_layout::counting_sort)
+			{
+				// Adjacent cells of a row are adjacent in `resources`, streams them as one range.
+				const resource* first = res_ptr + row[box.min_x].begin;
+				const resource* last = res_ptr + row[box.max_x - 1].begin + row[box.max_x - 1].num;
+				for (; first != last; ++first)
+				{
+					[[msvc::forceinline_calls]] visit(*first);
+				}
+			}
+			else
+			{
+				for (int32_t i = box.min_x; i < box.max_x; ++i)
+				{
+					int32_t head = row[i].head;
+					while (head)
+					{
+						resource const& res = res_ptr[head - 1];
+						[[msvc::forceinline_calls]] visit(res);
+						head = res.next;
+					}
+				}
+			}
+		}
+	}
+
+
+
+	template <typename _callable_t>
+	void grid2d_accelerator::for_each_pair(float radius, _callable_t&& callable) const
+	{
+		if (radius <= 0) [[unlikely]]
+		{
+			return;
+		}
+
+		if (boundary == grid_boundary::periodic)
+		{
+			for_each_pair_periodic(radius, callable);
+			return;
+		}
+
+		const float radius_squared = math::square(radius);
+		const int32_t grid_radius = grid_radius_of(radius);
+		const resource* res_ptr = resources.data();
+
+		const auto visit = [&](resource const& a, resource const& b)
+			{
+				const vec2 delta = b.position - a.position;
+				if (float distance_squared = delta.length_squared(); distance_squared < radius_squared)
+				{
+					callable(a.index, b.index, distance_squared, delta);
+				}
+			};
+
+		// Half-shell stencil: a cell is paired with itself, the cells on its right in the same row,
+		// and the cells of the next `grid_radius` rows, so every pair of cells is visited once.
+		for (int32_t y = 0; y < rows; ++y)
+		{
+			for (int32_t x = 0; x < cols; ++x)
+			{
+				const grid& curr = grids[x + (y * cols)];
+				if (curr.num == 0)
+				{
+					continue;
+				}
+
+				const int32_t min_x = std::max(x - grid_radius, 0);
+				const int32_t max_x = std::min(x + grid_radius + 1, cols);
+				const int32_t max_y = std::min(y + grid_radius + 1, rows);
+
+				if (layout != grid_layout::linked_list)
+				{
+					// `fetch(slot)` reads a sorted particle, by reference from `resources` or by value from the sorted arrays.
+					const auto sweep = [&](auto&& fetch)
+						{
+							const int32_t first = curr.begin;
+							const int32_t last = first + (int32_t)curr.num;
+
+							// Adjacent cells of a row are adjacent in storage, visits each row of the stencil as one range.
+							const auto visit_range = [&](const grid* row, int32_t from_x, int32_t to_x)
+								{
+									if (from_x >= to_x)
+									{
+										return;
+									}
+									const int32_t other_first = row[from_x].begin;
+									const int32_t other_last = row[to_x - 1].begin + (int32_t)row[to_x - 1].num;
+									for (int32_t a = first; a != last; ++a)
+									{
+										auto&& res_a = fetch(a);
+										for (int32_t b = other_first; b != other_last; ++b)
+										{
+											[[msvc::forceinline_calls]] visit(res_a, fetch(b));
+										}
+									}
+								};
+
+							for (int32_t a = first; a != last; ++a)
+							{
+								auto&& res_a = fetch(a);
+								for (int32_t b = a + 1; b != last; ++b)
+								{
+									[[msvc::forceinline_calls]] visit(res_a, fetch(b));
+								}
+							}
+
+							visit_range(grids.data() + (y * cols), x + 1, max_x);
+							for (int32_t j = y + 1; j < max_y; ++j)
+							{
+								visit_range(grids.data() + (j * cols), min_x, max_x);
+							}
+						};
+
+					if (layout == grid_layout::sorted_arrays)
+					{
+						sweep([this](int32_t slot) { return sorted_at(slot); });
+					}
+					else
+					{
+						sweep([res_ptr](int32_t slot) -> resource const& { return res_ptr[slot]; });
+					}
+				}
+				else
+				{
+					const auto visit_cell = [&](grid const& other)
+						{
+							for (int32_t a = curr.head; a; a = res_ptr[a - 1].next)
+							{
+								for (int32_t b = other.head; b; b = res_ptr[b - 1].next)
+								{
+									[[msvc::forceinline_calls]] visit(res_ptr[a - 1], res_ptr[b - 1]);
+								}
+							}
+						};
+
+					for (int32_t a = curr.head; a; a = res_ptr[a - 1].next)
+					{
+						for (int32_t b = res_ptr[a - 1].next; b; b = res_ptr[b - 1].next)
+						{
+							[[msvc::forceinline_calls]] visit(res_ptr[a - 1], res_ptr[b - 1]);
+						}
+					}
+
+					for (int32_t i = x + 1; i < max_x; ++i)
+					{
+						visit_cell(grids[i + (y * cols)]);
+					}
+					for (int32_t j = y + 1; j < max_y; ++j)
+					{
+						for (int32_t i = min_x; i < max_x; ++i)
+						{
+							visit_cell(grids[i + (j * cols)]);
+						}
+					}
+				}
+			}
+		}
+	}
+
+
+
+	template <typename _callable_t>
+	void grid2d_accelerator::query_aabb(vec2 lower, vec2 upper, _callable_t&& callable) const
+	{
+		if (lower.x > upper.x || lower.y > upper.y) [[unlikely]]
+		{
+			return;
+		}
+
+		// Particles out of the scene are clamped into the border cells, so the box is clamped likewise.
+		const int32_t min_x = (int32_t)std::clamp(std::floor(lower.x * inverse_cell_size), 0.f, float(cols - 1));
+		const int32_t min_y = (int32_t)std::clamp(std::floor(lower.y * inverse_cell_size), 0.f, float(rows - 1));
+		const int32_t max_x = (int32_t)std::clamp(std::floor(upper.x * inverse_cell_size), 0.f, float(cols - 1));
+		const int32_t max_y = (int32_t)std::clamp(std::floor(upper.y * inverse_cell_size), 0.f, float(rows - 1));
+
+		for (int32_t j = min_y; j <= max_y; ++j)
+		{
+			for_each_in_row(j, min_x, max_x + 1, [&](resource const& res)
+				{
+					vec2 const& found_position = res.position;
+					if (found_position.x >= lower.x && found_position.x <= upper.x && found_position.y >= lower.y && found_position.y <= upper.y)
+					{
+						callable(res.index, found_position);
+					}
+				});
+		}
+	}
+
+
+
+	template <typename _callable_t>
+	void grid2d_accelerator::query_segment(std::size_t index, vec2 from, vec2 to, float radius, _callable_t&& callable) const
+	{
+		if (radius <= 0) [[unlikely]]
+		{
+			return;
+		}
+
+		const float radius_squared = math::square(radius);
+		const vec2 delta = to - from;
+		const float length_squared = delta.length_squared();
+		const float inverse_length_squared = length_squared > 0 ? 1.f / length_squared : 0.f;
+
+		walk_segment(from, to, radius, [](float) { return true; }, [&](resource const& res)
+			{
+				if (index != (std::size_t)res.index) // ignore self.
+				{
+					vec2 const& found_position = res.position;
+					const vec2 offset = found_position - from;
+					const float t = std::clamp((offset.x * delta.x + offset.y * delta.y) * inverse_length_squared, 0.f, 1.f);
+					if (float distance_squared = found_position.distance_squared(from + delta * t); distance_squared < radius_squared)
+					{
+						callable(res.index, distance_squared, found_position);
+					}
+				}
+			});
+	}
+
+
+
+	template <typename _enter_t, typename _visit_t>
+	void grid2d_accelerator::walk_segment(vec2 from, vec2 to, float radius, _enter_t&& enter, _visit_t&& visit) const
+	{
+		// DDA along the major axis, in cell units: each step visits one column (or row) of cells, spanning the minor extent
+		// of the segment over that strip widened by `radius`. Border strips extend to infinity, as they hold the clamped particles.
+		const vec2 start = from * inverse_cell_size;
+		const vec2 delta = (to - from) * inverse_cell_size;
+		const float grid_radius = radius * inverse_cell_size;
+		const int32_t major = std::abs(delta.x) >= std::abs(delta.y) ? 0 : 1;
+		const int32_t minor = 1 - major;
+		const int32_t num_major = major == 0 ? cols : rows;
+		const int32_t num_minor = major == 0 ? rows : cols;
+		const float inverse_delta = delta[major] != 0 ? 1.f / delta[major] : 0.f;
+
+		const auto cell_of = [](float coordinate, int32_t num)
+			{
+				return (int32_t)std::clamp(std::floor(coordinate), 0.f, float(num - 1));
+			};
+
+		const float end = start[major] + delta[major];
+		const int32_t first = cell_of(std::min(start[major], end) - grid_radius, num_major);
+		const int32_t last = cell_of(std::max(start[major], end) + grid_radius, num_major);
+		const int32_t step = delta[major] < 0 ? -1 : 1;
+
+		for (int32_t m = step > 0 ? first : last; m >= first && m <= last; m += step)
+		{
+			// Parameter range of the segment over the widened strip.
+			const float low = m == 0 ? std::numeric_limits<float>::lowest() : m - grid_radius;
+			const float high = m == num_major - 1 ? std::numeric_limits<float>::max() : m + 1 + grid_radius;
+			float t0 = 0, t1 = 1;
+			if (delta[major] != 0)
+			{
+				const float ta = (low - start[major]) * inverse_delta;
+				const float tb = (high - start[major]) * inverse_delta;
+				t0 = std::max(std::min(ta, tb), 0.f);
+				t1 = std::min(std::max(ta, tb), 1.f);
+			}
+			else if (start[major] < low || start[major] > high)
+			{
+				continue;
+			}
+
+			if (t0 > t1)
+			{
+				continue;
+			}
+			if (!enter(t0))
+			{
+				return;
+			}
+
+			const float minor_0 = start[minor] + delta[minor] * t0;
+			const float minor_1 = start[minor] + delta[minor] * t1;
+			const int32_t min_n = cell_of(std::min(minor_0, minor_1) - grid_radius, num_minor);
+			const int32_t max_n = cell_of(std::max(minor_0, minor_1) + grid_radius, num_minor);
+			if (major == 0)
+			{
+				for (int32_t n = min_n; n <= max_n; ++n)
+				{
+					for_each_in_cell(grids[m + (n * cols)], visit);
+				}
+			}
+			else
+			{
+				for_each_in_row(m, min_n, max_n + 1, visit);
+			}
+		}
+	}
+
+
+
+	template <typename _callable_t>
+	void grid2d_accelerator::query_near_of_periodic(std::size_t index, vec2 position, float radius, _callable_t&& callable) const
+	{
+		const float radius_squared = math::square(radius);
+		const int32_t reach = grid_radius_of(radius) + periodic_slack;
+		const int32_t center = slot_of(position);
+
+		// Offsets wrap around, a box wider than the grid visits every column (row) once.
+		const int32_t span_x = std::min(2 * reach + 1, cols);
+		const int32_t span_y = std::min(2 * reach + 1, rows);
+		const int32_t first_x = span_x == cols ? 0 : wrap_cell(center % cols - reach, cols);
+		const int32_t first_y = span_y == rows ? 0 : center / cols - reach;
+
+		const auto visit = [&](resource const& res)
+			{
+				if (index != (std::size_t)res.index) // ignore self.
+				{
+					const vec2 delta = minimum_image(res.position - position);
+					if (float distance_squared = delta.length_squared(); distance_squared < radius_squared)
+					{
+						callable(res.index, distance_squared, position + delta);
+					}
+				}
+			};
+
+		for (int32_t j = 0; j < span_y; ++j)
+		{
+			// The wrapped columns are at most two ranges of the row.
+			const int32_t y = wrap_cell(first_y + j, rows);
+			if (first_x + span_x <= cols)
+			{
+				for_each_in_row(y, first_x, first_x + span_x, visit);
+			}
+			else
+			{
+				for_each_in_row(y, first_x, cols, visit);
+				for_each_in_row(y, 0, first_x + span_x - cols, visit);
+			}
+		}
+	}
+
+
+
+	template <typename _callable_t>
+	void grid2d_accelerator::for_each_pair_periodic(float radius, _callable_t&& callable) const
+	{
+		const float radius_squared = math::square(radius);
+		const int32_t reach = grid_radius_of(radius) + periodic_slack;
+
+		if (2 * reach + 1 > cols || 2 * reach + 1 > rows)
+		{
+			// The stencil would reach some cell twice, pairs each particle with the greater indices instead.
+			for (const grid& curr : grids)
+			{
+				for_each_in_cell(curr, [&](resource const& a)
+					{
+						query_near_of_periodic(a.index, a.position, radius, [&](int other, float distance_squared, vec2 const image)
+							{
+								if (a.index < other)
+								{
+									callable(a.index, other, distance_squared, image - a.position);
+								}
+							});
+					});
+			}
+			return;
+		}
+
+		const auto visit = [&](resource const& a, resource const& b)
+			{
+				const vec2 delta = minimum_image(b.position - a.position);
+				if (float distance_squared = delta.length_squared(); distance_squared < radius_squared)
+				{
+					callable(a.index, b.index, distance_squared, delta);
+				}
+			};
+
+		const auto visit_cells = [&](grid const& curr, grid const& other)
+			{
+				for_each_in_cell(curr, [&](resource const& a)
+					{
+						for_each_in_cell(other, [&](resource const& b)
+							{
+								[[msvc::forceinline_calls]] visit(a, b);
+							});
+					});
+			};
+
+		// Half-shell stencil with wrapped offsets, distinct since the stencil is narrower than the grid.
+		for (int32_t y = 0; y < rows; ++y)
+		{
+			for (int32_t x = 0; x < cols; ++x)
+			{
+				const grid& curr = grids[x + (y * cols)];
+				if (curr.num == 0)
+				{
+					continue;
+				}
+
+				for_each_pair_in_cell(curr, [&](resource const& a, resource const& b)
+					{
+						[[msvc::forceinline_calls]] visit(a, b);
+					});
+
+				for (int32_t i = 1; i <= reach; ++i)
+				{
+					visit_cells(curr, grids[wrap_cell(x + i, cols) + (y * cols)]);
+				}
+				for (int32_t j = 1; j <= reach; ++j)
+				{
+					const grid* row = grids.data() + (wrap_cell(y + j, rows) * cols);
+					for (int32_t i = -reach; i <= reach; ++i)
+					{
+						visit_cells(curr, row[wrap_cell(x + i, cols)]);
+					}
+				}
+			}
+		}
+	}
 }
\ No newline at end of file
@@ -0,0 +1,284 @@
+﻿// Copyright (c) 2024 Fong ZiSing. All rights reserved.
+//
+//     HashAccelerator.hpp
+//
+
+#pragma once
+
+#include "Starry/Core/Public/Vector.hpp"
+#include "AcceleratorConcept.hpp"
+
+#include <vector>
+#include <span>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+
+
+
+namespace se
+{
+	/**
+	 * @brief Spatial hash of uniform cells, only occupied cells are stored, and the scene has no bounds.
+	 * @details 稀疏哈希网格，内存仅与被占用的网格数量相关，场景无边界
+	 */
+	class hash2d_accelerator
+	{
+	private:
+		struct alignas(16) resource
+		{
+			vec2 position;
+			int32_t index;
+			int32_t reserved;
+		};
+
+		/** An open-addressing slot, empty while `num` is 0. */
+		struct alignas(16) bucket
+		{
+			uint64_t key;
+			int32_t begin;
+			int32_t num;
+		};
+
+		static constexpr int32_t coord_limit = 1 << 30;
+		static constexpr std::size_t min_capacity = 64;
+		float cell_size, inverse_cell_size;
+		std::size_t occupied = 0;
+		std::vector<bucket> buckets;
+		std::vector<resource> resources;
+		std::vector<int32_t> slots;
+
+
+	public:
+		static constexpr float default_cell_size = 8.f;
+
+		explicit hash2d_accelerator(float in_cell_size = default_cell_size)
+			: cell_size(std::max(in_cell_size, 1e-3f))
+			, inverse_cell_size(1.f / cell_size)
+			, buckets(min_capacity, bucket{})
+		{}
+
+		[[nodiscard]] float get_cell_size() const noexcept
+		{
+			return cell_size;
+		}
+
+		/**
+		 * @brief Retrieves the number of occupied cells.
+		 */
+		[[nodiscard]] std::size_t num_cells() const noexcept
+		{
+			return occupied;
+		}
+
+		/**
+		 * @brief rebuild hash's indexing information.
+		 * @details 更新索引信息
+		 */
+		void rebuild(std::span<const vec2> positions);
+
+		/**
+		 * @brief Invokes `callable(index, distance_squared, position)` for every particle within `radius` of `position`,
+		 *        the particle at `index` itself is skipped.
+		 * @details 查询邻近粒子
+		 */
+		template <typename _callable_t>
+		void query_near_of(std::size_t index, vec2 position, float radius, _callable_t&& callable) const;
+
+		/**
+		 * @brief Type-erased version of the above, prefer passing the callable directly in hot loops.
+		 */
+		void query_near_of(std::size_t index, vec2 position, float radius, std::function<void(int, float, vec2 const)>&& callable) const;
+
+		/**
+		 * @brief Retrieves the size of the index.
+		 * @details 返回索引的统计信息
+		 */
+		[[nodiscard]] accelerator_stats stats() const noexcept;
+
+		/**
+		 * @brief Invokes `callable(index_a, index_b, distance_squared, position_b - position_a)` exactly once
+		 *        for every unordered pair of particles within `radius` of each other.
+		 * @details 枚举所有邻近粒子对（每对仅一次）
+		 */
+		template <typename _callable_t>
+		void for_each_pair(float radius, _callable_t&& callable) const;
+
+
+	private:
+		[[nodiscard]] int32_t coord_of(float value) const noexcept
+		{
+			return (int32_t)std::clamp(std::floor(value * inverse_cell_size), float(-coord_limit), float(coord_limit));
+		}
+
+		[[nodiscard]] static uint64_t key_of(int32_t x, int32_t y) noexcept
+		{
+			return (uint64_t(uint32_t(x)) << 32) | uint64_t(uint32_t(y));
+		}
+
+		[[nodiscard]] std::size_t home_of(uint64_t key) const noexcept
+		{
+			// Fibonacci hashing, the capacity is a power of two.
+			return std::size_t((key * 0x9E3779B97F4A7C15ull) >> 32) & (buckets.size() - 1);
+		}
+
+		/** Retrieves the bucket of a cell, or nullptr if the cell is empty. */
+		[[nodiscard]] const bucket* find(int32_t x, int32_t y) const noexcept
+		{
+			const uint64_t key = key_of(x, y);
+			const std::size_t mask = buckets.size() - 1;
+			for (std::size_t slot = home_of(key); ; slot = (slot + 1) & mask)
+			{
+				const bucket& curr = buckets[slot];
+				if (curr.num == 0)
+				{
+					return nullptr;
+				}
+				if (curr.key == key)
+				{
+					return &curr;
+				}
+			}
+		}
+
+		std::size_t insert(uint64_t key) noexcept;
+
+		/** Resizes the table to `capacity` buckets and rehashes the occupied ones. */
+		void reserve_buckets(std::size_t capacity);
+
+		/** Empties the table and resizes it to `capacity` buckets, without rehashing. */
+		void clear_buckets(std::size_t capacity);
+
+
+	private:
+		/** Non-copyable. */
+		hash2d_accelerator(const hash2d_accelerator&) = delete;
+		hash2d_accelerator& operator = (const hash2d_accelerator&) = delete;
+
+		/** Disable new. */
+		void* operator new (std::size_t, void*) = delete;
+		void* operator new (std::size_t) = delete;
+	};
+}
+
+
+
+namespace se
+{
+	template <typename _callable_t>
+	[[msvc::forceinline]] void hash2d_accelerator::query_near_of(std::size_t index, vec2 position, float radius, _callable_t&& callable) const
+	{
+		if (radius <= 0 || occupied == 0) [[unlikely]]
+		{
+			return;
+		}
+
+		const float radius_squared = math::square(radius);
+		const int32_t min_x = coord_of(position.x - radius);
+		const int32_t min_y = coord_of(position.y - radius);
+		const int32_t max_x = coord_of(position.x + radius);
+		const int32_t max_y = coord_of(position.y + radius);
+		const resource* res_ptr = resources.data();
+
+		const auto visit_cell = [&](bucket const& cell)
+			{
+				const resource* first = res_ptr + cell.begin;
+				const resource* last = first + cell.num;
+				for (; first != last; ++first)
+				{
+					if (index != (std::size_t)first->index) // ignore self.
+					{
+						vec2 const& found_position = first->position;
+						if (float distance_squared = position.distance_squared(found_position); distance_squared < radius_squared)
+						{
+							callable(first->index, distance_squared, found_position);
+						}
+					}
+				}
+			};
+
+		// A box wider than the occupied cells is cheaper to answer by scanning the table.
+		const uint64_t box_cells = uint64_t(max_x - min_x + 1) * uint64_t(max_y - min_y + 1);
+		if (box_cells > occupied)
+		{
+			for (bucket const& cell : buckets)
+			{
+				const int32_t x = int32_t(uint32_t(cell.key >> 32));
+				const int32_t y = int32_t(uint32_t(cell.key));
+				if (cell.num != 0 && x >= min_x && x <= max_x && y >= min_y && y <= max_y)
+				{
+					visit_cell(cell);
+				}
+			}
+			return;
+		}
+
+		for (int32_t j = min_y; j <= max_y; ++j)
+		{
+			for (int32_t i = min_x; i <= max_x; ++i)
+			{
+				if (const bucket* cell = find(i, j))
+				{
+					visit_cell(*cell);
+				}
+			}
+		}
+	}
+
+
+
+	template <typename _callable_t>
+	void hash2d_accelerator::for_each_pair(float radius, _callable_t&& callable) const
+	{
+		if (radius <= 0 || occupied == 0) [[unlikely]]
+		{
+			return;
+		}
+
+		const float radius_squared = math::square(radius);
+		const int32_t grid_radius = (int32_t)std::ceil(radius * inverse_cell_size);
+		const resource* res_ptr = resources.data();
+
+		const auto visit_range = [&](const resource* first, const resource* last, const resource* other_first, const resource* other_last)
+			{
+				for (const resource* a = first; a != last; ++a)
+				{
+					for (const resource* b = (other_first ? other_first : a + 1); b != other_last; ++b)
+					{
+						const vec2 delta = b->position - a->position;
+						if (float distance_squared = delta.length_squared(); distance_squared < radius_squared)
+						{
+							callable(a->index, b->index, distance_squared, delta);
+						}
+					}
+				}
+			};
+
+		// Half-shell stencil over the occupied cells only.
+		for (bucket const& curr : buckets)
+		{
+			if (curr.num == 0)
+			{
+				continue;
+			}
+
+			const int32_t x = int32_t(uint32_t(curr.key >> 32));
+			const int32_t y = int32_t(uint32_t(curr.key));
+			const resource* first = res_ptr + curr.begin;
+			const resource* last = first + curr.num;
+
+			visit_range(first, last, nullptr, last);
+			for (int32_t j = y; j <= y + grid_radius; ++j)
+			{
+				for (int32_t i = (j == y ? x + 1 : x - grid_radius); i <= x + grid_radius; ++i)
+				{
+					if (const bucket* other = find(i, j))
+					{
+						const resource* other_first = res_ptr + other->begin;
+						visit_range(first, last, other_first, other_first + other->num);
+					}
+				}
+			}
+		}
+	}
+}
\ No newline at end of file
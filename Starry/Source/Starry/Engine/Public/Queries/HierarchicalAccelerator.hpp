@@ -0,0 +1,318 @@
+﻿// Copyright (c) 2024 Fong ZiSing. All rights reserved.
+//
+//     HierarchicalAccelerator.hpp
+//
+
+#pragma once
+
+#include "Starry/Core/Public/Vector.hpp"
+#include "AcceleratorConcept.hpp"
+
+#include <vector>
+#include <span>
+#include <initializer_list>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+
+
+
+namespace se
+{
+	/**
+	 * @brief Several uniform grids of growing cell size over the same scene, all built from one pass over positions.
+	 *        Each query runs on the level whose cell size suits its radius, so that short and long range rules
+	 *        share one accelerator.
+	 * @details 多分辨率层级网格，每次查询自动选择与半径最匹配的层级
+	 */
+	class hierarchical_grid2d_accelerator
+	{
+	private:
+		struct alignas(16) resource
+		{
+			vec2 position;
+			int32_t index;
+			int32_t reserved;
+		};
+
+		struct grid
+		{
+			int32_t begin;
+			int32_t num;
+		};
+
+		/** Particles of a level are sorted by cell, the cells of a row are one contiguous range. */
+		struct level
+		{
+			float cell_size, inverse_cell_size;
+			int32_t cols, rows;
+			std::vector<grid> grids;
+		};
+
+		static constexpr int32_t grid_limit = 16384;
+
+		/** Cost of visiting one row range, in particle tests, used to choose the level of a query. */
+		static constexpr float row_cost = 8.f;
+
+		vec2i bounds;
+		std::vector<level> levels;
+
+		/** Level `l` owns [l * n, l * n + n) of both arrays. */
+		std::vector<resource> resources;
+		std::vector<int32_t> slots;
+		std::vector<int32_t> cursors;
+		std::size_t num_particles = 0;
+		float density = 0;
+		bool indexed = false;
+
+
+	public:
+		/**
+		 * @param cell_sizes Cell width of each level, in any order, duplicates are dropped.
+		 *                   Best set to the interaction radii the scene mixes.
+		 */
+		hierarchical_grid2d_accelerator(const vec2i& scene_size, std::initializer_list<float> cell_sizes = { 8.f, 32.f, 128.f })
+			: bounds(scene_size)
+		{
+			set_cell_sizes(cell_sizes);
+		}
+
+		[[nodiscard]] std::size_t num_levels() const noexcept
+		{
+			return levels.size();
+		}
+
+		/**
+		 * @brief Retrieves the cell width of a level, levels are ordered from the finest to the coarsest.
+		 */
+		[[nodiscard]] float get_cell_size(std::size_t in_level) const noexcept
+		{
+			return levels[in_level].cell_size;
+		}
+
+		/**
+		 * @brief Changes the levels, takes effect on the next rebuild, the grid is empty until then.
+		 * @details 修改各层级的网格大小，下一次更新索引时生效
+		 */
+		void set_cell_sizes(std::span<const float> cell_sizes);
+
+		void set_cell_sizes(std::initializer_list<float> cell_sizes)
+		{
+			set_cell_sizes(std::span<const float>(cell_sizes.begin(), cell_sizes.size()));
+		}
+
+		/**
+		 * @brief Retrieves the level a query of `radius` runs on, the one visiting the fewest particles and rows
+		 *        for the current particle density.
+		 * @details 返回给定半径的查询所使用的层级
+		 */
+		[[nodiscard]] std::size_t level_of(float radius) const noexcept;
+
+		/**
+		 * @brief rebuild the indexing information of all levels.
+		 * @details 更新所有层级的索引信息
+		 */
+		void rebuild(std::span<const vec2> positions) noexcept;
+
+		/**
+		 * @brief Updates the indexing information, only the levels where some particle crossed a cell are resorted,
+		 *        the others just refresh their cached position. Falls back to `rebuild()` if the particle count changed.
+		 * @details 增量更新索引信息，仅重排有粒子跨越网格的层级
+		 */
+		void update(std::span<const vec2> positions) noexcept;
+
+		/**
+		 * @brief Invokes `callable(index, distance_squared, position)` for every particle within `radius` of `position`,
+		 *        the particle at `index` itself is skipped.
+		 * @details 查询邻近粒子
+		 */
+		template <typename _callable_t>
+		void query_near_of(std::size_t index, vec2 position, float radius, _callable_t&& callable) const;
+
+		/**
+		 * @brief Type-erased version of the above, prefer passing the callable directly in hot loops.
+		 */
+		void query_near_of(std::size_t index, vec2 position, float radius, std::function<void(int, float, vec2 const)>&& callable) const;
+
+		/**
+		 * @brief Retrieves the size of the index.
+		 * @details 返回索引的统计信息
+		 */
+		[[nodiscard]] accelerator_stats stats() const noexcept;
+
+		/**
+		 * @brief Invokes `callable(index_a, index_b, distance_squared, position_b - position_a)` exactly once
+		 *        for every unordered pair of particles within `radius` of each other.
+		 * @details 枚举所有邻近粒子对（每对仅一次）
+		 */
+		template <typename _callable_t>
+		void for_each_pair(float radius, _callable_t&& callable) const;
+
+
+	private:
+		[[nodiscard]] static int32_t cells_along(int32_t extent, float in_cell_size) noexcept
+		{
+			return std::clamp((int32_t)std::ceil(extent / in_cell_size), 1, grid_limit);
+		}
+
+		[[nodiscard]] static int32_t slot_of(level const& curr, vec2 position) noexcept
+		{
+			int32_t clamped_x = std::clamp(int32_t(position.x * curr.inverse_cell_size), 0, curr.cols - 1);
+			int32_t clamped_y = std::clamp(int32_t(position.y * curr.inverse_cell_size), 0, curr.rows - 1);
+			return clamped_x + (clamped_y * curr.cols);
+		}
+
+		template <typename _callable_t>
+		void query_near_of_level(std::size_t level_index, std::size_t index, vec2 position, float radius, _callable_t&& callable) const;
+
+		/**
+		 * @brief Computes the slot of every particle on every level, reading each position once.
+		 * @return The mask of the levels where some slot changed.
+		 */
+		uint32_t compute_slots(std::span<const vec2> positions) noexcept;
+
+		/** Counting sort of the levels in `level_mask`, scattering all of them in one pass over positions. */
+		void sort_by_slots(std::span<const vec2> positions, uint32_t level_mask) noexcept;
+
+
+	private:
+		/** Non-copyable. */
+		hierarchical_grid2d_accelerator(const hierarchical_grid2d_accelerator&) = delete;
+		hierarchical_grid2d_accelerator& operator = (const hierarchical_grid2d_accelerator&) = delete;
+
+		/** Disable new. */
+		void* operator new (std::size_t, void*) = delete;
+		void* operator new (std::size_t) = delete;
+	};
+}
+
+
+
+namespace se
+{
+	template <typename _callable_t>
+	[[msvc::forceinline]] void hierarchical_grid2d_accelerator::query_near_of(std::size_t index, vec2 position, float radius, _callable_t&& callable) const
+	{
+		if (radius <= 0 || !indexed) [[unlikely]]
+		{
+			return;
+		}
+
+		query_near_of_level(level_of(radius), index, position, radius, callable);
+	}
+
+
+
+	template <typename _callable_t>
+	[[msvc::forceinline]] void hierarchical_grid2d_accelerator::query_near_of_level(std::size_t level_index, std::size_t index, vec2 position, float radius, _callable_t&& callable) const
+	{
+		const level& curr = levels[level_index];
+		const float radius_squared = math::square(radius);
+		const int32_t grid_radius = (int32_t)std::ceil(radius * curr.inverse_cell_size);
+
+		// Particles out of the scene are clamped into the border cells, so is the center of the query.
+		const int32_t slot_x = std::clamp(int32_t(position.x * curr.inverse_cell_size), 0, curr.cols - 1);
+		const int32_t slot_y = std::clamp(int32_t(position.y * curr.inverse_cell_size), 0, curr.rows - 1);
+		const int32_t min_x = std::max(slot_x - grid_radius, 0);
+		const int32_t max_x = std::min(slot_x + grid_radius + 1, curr.cols);
+		const int32_t min_y = std::max(slot_y - grid_radius, 0);
+		const int32_t max_y = std::min(slot_y + grid_radius + 1, curr.rows);
+
+		const resource* res_ptr = resources.data() + level_index * num_particles;
+		for (int32_t j = min_y; j < max_y; ++j)
+		{
+			// Adjacent cells of a row are adjacent in `resources`, streams them as one range.
+			const grid* row = curr.grids.data() + (j * curr.cols);
+			const resource* first = res_ptr + row[min_x].begin;
+			const resource* last = res_ptr + row[max_x - 1].begin + row[max_x - 1].num;
+			for (; first != last; ++first)
+			{
+				if (index != (std::size_t)first->index) // ignore self.
+				{
+					if (float distance_squared = position.distance_squared(first->position); distance_squared < radius_squared)
+					{
+						callable(first->index, distance_squared, first->position);
+					}
+				}
+			}
+		}
+	}
+
+
+
+	template <typename _callable_t>
+	void hierarchical_grid2d_accelerator::for_each_pair(float radius, _callable_t&& callable) const
+	{
+		if (radius <= 0 || !indexed) [[unlikely]]
+		{
+			return;
+		}
+
+		const std::size_t level_index = level_of(radius);
+		const level& curr = levels[level_index];
+		const float radius_squared = math::square(radius);
+		const int32_t grid_radius = (int32_t)std::ceil(radius * curr.inverse_cell_size);
+		const resource* res_ptr = resources.data() + level_index * num_particles;
+
+		const auto visit = [&](resource const& a, resource const& b)
+			{
+				const vec2 delta = b.position - a.position;
+				if (float distance_squared = delta.length_squared(); distance_squared < radius_squared)
+				{
+					callable(a.index, b.index, distance_squared, delta);
+				}
+			};
+
+		// Half-shell stencil: a cell is paired with itself, the cells on its right in the same row,
+		// and the next `grid_radius` rows.
+		for (int32_t y = 0; y < curr.rows; ++y)
+		{
+			const grid* curr_row = curr.grids.data() + (y * curr.cols);
+			for (int32_t x = 0; x < curr.cols; ++x)
+			{
+				const grid& cell = curr_row[x];
+				if (cell.num == 0)
+				{
+					continue;
+				}
+
+				const resource* first = res_ptr + cell.begin;
+				const resource* last = first + cell.num;
+				const int32_t min_x = std::max(x - grid_radius, 0);
+				const int32_t max_x = std::min(x + grid_radius + 1, curr.cols);
+				const int32_t max_y = std::min(y + grid_radius + 1, curr.rows);
+
+				const auto visit_range = [&](const grid* row, int32_t from_x, int32_t to_x)
+					{
+						if (from_x >= to_x)
+						{
+							return;
+						}
+						const resource* other_first = res_ptr + row[from_x].begin;
+						const resource* other_last = res_ptr + row[to_x - 1].begin + row[to_x - 1].num;
+						for (const resource* a = first; a != last; ++a)
+						{
+							for (const resource* b = other_first; b != other_last; ++b)
+							{
+								[[msvc::forceinline_calls]] visit(*a, *b);
+							}
+						}
+					};
+
+				for (const resource* a = first; a != last; ++a)
+				{
+					for (const resource* b = a + 1; b != last; ++b)
+					{
+						[[msvc::forceinline_calls]] visit(*a, *b);
+					}
+				}
+
+				visit_range(curr_row, x + 1, max_x);
+				for (int32_t j = y + 1; j < max_y; ++j)
+				{
+					visit_range(curr.grids.data() + (j * curr.cols), min_x, max_x);
+				}
+			}
+		}
+	}
+}
\ No newline at end of file
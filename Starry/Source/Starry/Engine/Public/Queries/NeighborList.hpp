@@ -0,0 +1,130 @@
+﻿// Copyright (c) 2024 Fong ZiSing. All rights reserved.
+//
+//     NeighborList.hpp
+//
+
+#pragma once
+
+#include "Starry/Core/Public/Vector.hpp"
+#include "GridAccelerator.hpp"
+
+#include <vector>
+#include <span>
+
+
+
+namespace se
+{
+	/**
+	 * @brief Verlet neighbor list, caches the neighbors of every particle out to `radius + skin` in CSR form,
+	 *        and is only rebuilt once some particle has moved more than `skin / 2` since the last build.
+	 * @details Verlet 邻居列表，粒子位移超过 skin/2 时才重建
+	 */
+	class verlet_neighbor_list
+	{
+	private:
+		struct index_pair
+		{
+			int32_t a, b;
+		};
+
+		float radius;
+		float skin;
+		bool built = false;
+		const grid2d_accelerator* grid = nullptr;
+		std::vector<int32_t> offsets;
+		std::vector<int32_t> indices;
+		std::vector<vec2> reference_positions;
+		std::vector<vec2> cached_positions;
+		std::vector<index_pair> pairs;
+		std::vector<int32_t> cursors;
+
+
+	public:
+		verlet_neighbor_list(float in_radius, float in_skin)
+			: radius(in_radius)
+			, skin(in_skin)
+		{}
+
+		[[nodiscard]] float get_radius() const noexcept
+		{
+			return radius;
+		}
+
+		[[nodiscard]] float get_skin() const noexcept
+		{
+			return skin;
+		}
+
+		/**
+		 * @brief Checks whether some particle has moved more than `skin / 2` since the last build.
+		 *        With `grid_boundary::periodic`, the displacement is the minimum image one, so wrapping is not a move.
+		 */
+		[[nodiscard]] bool needs_rebuild(std::span<const vec2> positions) const noexcept;
+
+		/**
+		 * @brief Caches the positions of this frame, and rebuilds both `accel` and the list only if needed.
+		 * @return true if the list was rebuilt.
+		 * @details 缓存本帧位置，仅在需要时重建网格与邻居列表
+		 */
+		bool update(grid2d_accelerator& accel, std::span<const vec2> positions);
+
+		/**
+		 * @brief Rebuilds `accel` and the list unconditionally.
+		 */
+		void rebuild(grid2d_accelerator& accel, std::span<const vec2> positions);
+
+		/**
+		 * @brief Retrieves the cached neighbor indices of a particle, out to `radius + skin`.
+		 */
+		[[nodiscard]] std::span<const int32_t> neighbors_of(std::size_t index) const noexcept
+		{
+			return std::span<const int32_t>(indices.data() + offsets[index], indices.data() + offsets[index + 1]);
+		}
+
+		/**
+		 * @brief Invokes `callable(index, distance_squared, position)` for every cached neighbor within `radius`,
+		 *        using the positions cached by the last `update()`.
+		 *        With `grid_boundary::periodic`, the reported position is the nearest image, as in `grid2d_accelerator::query_near_of()`.
+		 * @details 遍历半径内的邻居
+		 */
+		template <typename _callable_t>
+		[[msvc::forceinline]] void query_near_of(std::size_t index, vec2 position, _callable_t&& callable) const
+		{
+			const float radius_squared = math::square(radius);
+			const vec2* pos_ptr = cached_positions.data();
+			if (is_periodic())
+			{
+				for (int32_t neighbor : neighbors_of(index))
+				{
+					const vec2 delta = grid->minimum_image(pos_ptr[neighbor] - position);
+					if (float distance_squared = delta.length_squared(); distance_squared < radius_squared)
+					{
+						callable(neighbor, distance_squared, position + delta);
+					}
+				}
+				return;
+			}
+
+			for (int32_t neighbor : neighbors_of(index))
+			{
+				vec2 const& found_position = pos_ptr[neighbor];
+				if (float distance_squared = position.distance_squared(found_position); distance_squared < radius_squared)
+				{
+					callable(neighbor, distance_squared, found_position);
+				}
+			}
+		}
+
+
+	private:
+		[[nodiscard]] bool is_periodic() const noexcept
+		{
+			return grid != nullptr && grid->get_boundary() == grid_boundary::periodic;
+		}
+
+		/** Non-copyable. */
+		verlet_neighbor_list(const verlet_neighbor_list&) = delete;
+		verlet_neighbor_list& operator = (const verlet_neighbor_list&) = delete;
+	};
+}
\ No newline at end of file
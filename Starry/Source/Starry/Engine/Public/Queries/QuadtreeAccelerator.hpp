@@ -0,0 +1,282 @@
+﻿// Copyright (c) 2024 Fong ZiSing. All rights reserved.
+//
+//     QuadtreeAccelerator.hpp
+//
+
+#pragma once
+
+#include "Starry/Core/Public/Vector.hpp"
+#include "AcceleratorConcept.hpp"
+
+#include <vector>
+#include <span>
+#include <functional>
+#include <algorithm>
+#include <limits>
+
+
+
+namespace se
+{
+	/**
+	 * @brief Adaptive quadtree, nodes are subdivided by occupancy so that clustered particles stay in small leaves.
+	 *        Built from Morton-sorted particles into a linear, pointer-free node array.
+	 * @details 自适应四叉树，按占用数量细分，适用于强聚集的粒子分布
+	 */
+	class quadtree2d_accelerator
+	{
+	private:
+		struct alignas(16) resource
+		{
+			vec2 position;
+			int32_t index;
+			int32_t reserved;
+		};
+
+		/** The four children of a node are adjacent, a leaf has no child. */
+		struct alignas(32) node
+		{
+			vec2 min;
+			vec2 max;
+			int32_t first_child;
+			int32_t begin;
+			int32_t end;
+			int32_t level;
+		};
+
+		static constexpr int32_t max_level = 16;
+		static constexpr int32_t max_stack = 4 * max_level + 4;
+
+		/** A pair expands into at most 10 pairs, and lowers the level of at least one side. */
+		static constexpr int32_t max_pair_stack = 10 * 2 * max_level + 4;
+		int32_t leaf_capacity;
+		std::vector<node> nodes;
+		std::vector<resource> resources;
+		std::vector<uint64_t> keys;
+
+
+	public:
+		static constexpr int32_t default_leaf_capacity = 16;
+
+		explicit quadtree2d_accelerator(int32_t in_leaf_capacity = default_leaf_capacity)
+			: leaf_capacity(std::max(in_leaf_capacity, 1))
+		{}
+
+		/**
+		 * @brief Retrieves the number of nodes.
+		 */
+		[[nodiscard]] std::size_t num_nodes() const noexcept
+		{
+			return nodes.size();
+		}
+
+		/**
+		 * @brief rebuild quadtree's indexing information.
+		 * @details 更新索引信息
+		 */
+		void rebuild(std::span<const vec2> positions);
+
+		/**
+		 * @brief rebuild quadtree's indexing information on the engine thread pool,
+		 *        the result is identical to `rebuild()`.
+		 * @details 多线程更新索引信息
+		 */
+		void par_rebuild(std::span<const vec2> positions);
+
+		/**
+		 * @brief Invokes `callable(index, distance_squared, position)` for every particle within `radius` of `position`,
+		 *        the particle at `index` itself is skipped.
+		 * @details 查询邻近粒子
+		 */
+		template <typename _callable_t>
+		void query_near_of(std::size_t index, vec2 position, float radius, _callable_t&& callable) const;
+
+		/**
+		 * @brief Type-erased version of the above, prefer passing the callable directly in hot loops.
+		 */
+		void query_near_of(std::size_t index, vec2 position, float radius, std::function<void(int, float, vec2 const)>&& callable) const;
+
+		/**
+		 * @brief Retrieves the size of the index.
+		 * @details 返回索引的统计信息
+		 */
+		[[nodiscard]] accelerator_stats stats() const noexcept;
+
+		/**
+		 * @brief Invokes `callable(index_a, index_b, distance_squared, position_b - position_a)` exactly once
+		 *        for every unordered pair of particles within `radius` of each other.
+		 *        Walks pairs of nodes, a node with itself included, each unordered pair once and pruned by the distance
+		 *        of their bounds, so every pair of particles is tested once.
+		 * @details 枚举所有邻近粒子对（每对仅一次）
+		 */
+		template <typename _callable_t>
+		void for_each_pair(float radius, _callable_t&& callable) const;
+
+
+	private:
+		void build(std::span<const vec2> positions, std::size_t num_chunks);
+
+		void build_nodes();
+
+
+	private:
+		/** Non-copyable. */
+		quadtree2d_accelerator(const quadtree2d_accelerator&) = delete;
+		quadtree2d_accelerator& operator = (const quadtree2d_accelerator&) = delete;
+
+		/** Disable new. */
+		void* operator new (std::size_t, void*) = delete;
+		void* operator new (std::size_t) = delete;
+	};
+}
+
+
+
+namespace se
+{
+	template <typename _callable_t>
+	[[msvc::forceinline]] void quadtree2d_accelerator::query_near_of(std::size_t index, vec2 position, float radius, _callable_t&& callable) const
+	{
+		if (radius <= 0 || nodes.empty()) [[unlikely]]
+		{
+			return;
+		}
+
+		const float radius_squared = math::square(radius);
+		const resource* res_ptr = resources.data();
+
+		int32_t stack[max_stack];
+		int32_t top = 0;
+		stack[top++] = 0;
+
+		while (top > 0)
+		{
+			node const& curr = nodes[stack[--top]];
+
+			// Distance from the query to the tight bounds of the node.
+			const float dx = std::max({ curr.min.x - position.x, 0.f, position.x - curr.max.x });
+			const float dy = std::max({ curr.min.y - position.y, 0.f, position.y - curr.max.y });
+			if (dx * dx + dy * dy >= radius_squared)
+			{
+				continue;
+			}
+
+			if (curr.first_child >= 0)
+			{
+				for (int32_t child = 0; child < 4; ++child)
+				{
+					stack[top++] = curr.first_child + child;
+				}
+				continue;
+			}
+
+			const resource* first = res_ptr + curr.begin;
+			const resource* last = res_ptr + curr.end;
+			for (; first != last; ++first)
+			{
+				if (index != (std::size_t)first->index) // ignore self.
+				{
+					vec2 const& found_position = first->position;
+					if (float distance_squared = position.distance_squared(found_position); distance_squared < radius_squared)
+					{
+						callable(first->index, distance_squared, found_position);
+					}
+				}
+			}
+		}
+	}
+
+
+
+	template <typename _callable_t>
+	void quadtree2d_accelerator::for_each_pair(float radius, _callable_t&& callable) const
+	{
+		if (radius <= 0 || nodes.empty()) [[unlikely]]
+		{
+			return;
+		}
+
+		const float radius_squared = math::square(radius);
+		const resource* res_ptr = resources.data();
+		const node* node_ptr = nodes.data();
+
+		struct node_pair
+		{
+			int32_t a, b;
+		};
+		node_pair stack[max_pair_stack];
+		int32_t top = 0;
+		stack[top++] = node_pair{ 0, 0 };
+
+		while (top > 0)
+		{
+			const node_pair pair = stack[--top];
+			node const& a = node_ptr[pair.a];
+			node const& b = node_ptr[pair.b];
+
+			if (pair.a == pair.b)
+			{
+				if (a.first_child >= 0)
+				{
+					// The children with themselves and with the children after them.
+					for (int32_t i = 0; i < 4; ++i)
+					{
+						for (int32_t j = i; j < 4; ++j)
+						{
+							stack[top++] = node_pair{ a.first_child + i, a.first_child + j };
+						}
+					}
+					continue;
+				}
+
+				for (int32_t slot_a = a.begin; slot_a < a.end; ++slot_a)
+				{
+					resource const& res_a = res_ptr[slot_a];
+					for (int32_t slot_b = slot_a + 1; slot_b < a.end; ++slot_b)
+					{
+						resource const& res_b = res_ptr[slot_b];
+						const vec2 delta = res_b.position - res_a.position;
+						if (float distance_squared = delta.length_squared(); distance_squared < radius_squared)
+						{
+							callable(res_a.index, res_b.index, distance_squared, delta);
+						}
+					}
+				}
+				continue;
+			}
+
+			// Distance between the tight bounds of the nodes, empty nodes have inverted bounds and are always too far.
+			const float dx = std::max({ a.min.x - b.max.x, 0.f, b.min.x - a.max.x });
+			const float dy = std::max({ a.min.y - b.max.y, 0.f, b.min.y - a.max.y });
+			if (dx * dx + dy * dy >= radius_squared)
+			{
+				continue;
+			}
+
+			// Splits the larger node, or the only one that has children.
+			const bool split_a = a.first_child >= 0 && (b.first_child < 0 || a.level <= b.level);
+			if (split_a || b.first_child >= 0)
+			{
+				for (int32_t child = 0; child < 4; ++child)
+				{
+					stack[top++] = split_a ? node_pair{ a.first_child + child, pair.b } : node_pair{ pair.a, b.first_child + child };
+				}
+				continue;
+			}
+
+			for (int32_t slot_a = a.begin; slot_a < a.end; ++slot_a)
+			{
+				resource const& res_a = res_ptr[slot_a];
+				for (int32_t slot_b = b.begin; slot_b < b.end; ++slot_b)
+				{
+					resource const& res_b = res_ptr[slot_b];
+					const vec2 delta = res_b.position - res_a.position;
+					if (float distance_squared = delta.length_squared(); distance_squared < radius_squared)
+					{
+						callable(res_a.index, res_b.index, distance_squared, delta);
+					}
+				}
+			}
+		}
+	}
+}
\ No newline at end of file
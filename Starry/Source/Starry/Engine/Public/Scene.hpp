@@ -10,45 +10,113 @@
 #include "Accelerator.hpp"
 
 #include <type_traits>
+#include <algorithm>
 
 
 
 namespace se
 {
-	class scene2d
+	/**
+	 * @brief A particle scene, particles register a `_vector_t` position (`vec2` or `vec3`),
+	 *        `_accelerator_t` is the spatial index answering its queries.
+	 * @details 粒子场景，坐标类型与空间加速结构由模板参数指定
+	 */
+	template <typename _vector_t, accelerator<_vector_t> _accelerator_t>
+	class basic_scene
 	{
+	public:
+		using vector_type = _vector_t;
+		using size_type = std::conditional_t<std::same_as<_vector_t, vec3>, vec3i, vec2i>;
+
+
 	private:
 		particle_system system;
-		vec2i size;
-		grid2d_accelerator accel;
+		size_type size;
+		_accelerator_t accel;
+		uint32_t spatial_sort_interval = 0;
+		uint32_t frame_count = 0;
+		std::vector<uint64_t> spatial_keys;
+		std::vector<uint32_t> spatial_order;
 	
 
 	protected:
-		scene2d(vec2i const& in_scene_size) noexcept
+		/** The accelerator is built from the scene size and `args`, or from `args` alone if it has no bounds. */
+		template <typename... _args_t>
+		basic_scene(size_type const& in_scene_size, _args_t&&... args) noexcept
 			: size{ in_scene_size }
-			, accel{ in_scene_size }
+			, accel{ make_accelerator(in_scene_size, std::forward<_args_t>(args)...) }
 		{}
 
 
 	public:
-		friend scene2d make_scene(vec2i const& in_scene_size);
-	
-		const vec2i& scene_size() const noexcept
+		const size_type& scene_size() const noexcept
 		{
 			return size;
 		}
 
-		const grid2d_accelerator* get_accelerator() const noexcept
+		const _accelerator_t* get_accelerator() const noexcept
 		{
 			return &accel;
 		}
 
+		/**
+		 * @brief With `grid_boundary::periodic`, positions are wrapped into the scene on every `begin_update()`.
+		 * @details 设置场景的边界条件
+		 */
+		void set_boundary(grid_boundary in_boundary) noexcept requires std::same_as<_accelerator_t, grid2d_accelerator>
+		{
+			accel.set_boundary(in_boundary);
+		}
+
 		template<typename _user_particle_t, typename _generator_t>
 		void generate_particle(_generator_t&& generator)
 		{
 			system.generate_particle<_user_particle_t>(generator(size));
 		}
 
+		/**
+		 * @brief Retrieves the stable handle of the particle at `index`.
+		 * @details 返回给定下标的粒子句柄
+		 */
+		template<typename _user_particle_t>
+		[[nodiscard]] particle_handle handle_of(std::size_t index) const
+		{
+			return system.handle_of<_user_particle_t>(index);
+		}
+
+		/**
+		 * @brief Retrieves the current index of a particle, or `ecs::entity_table::invalid_index` if it was destroyed.
+		 * @details 返回粒子句柄对应的下标
+		 */
+		template<typename _user_particle_t>
+		[[nodiscard]] std::size_t index_of(particle_handle handle) const
+		{
+			return system.index_of<_user_particle_t>(handle);
+		}
+
+		/**
+		 * @brief Destroys one particle, the last particle takes its index.
+		 *        Indices cached by the accelerator are stale until the next `begin_update()`, which rebuilds it.
+		 * @details 删除单个粒子
+		 */
+		template<typename _user_particle_t>
+		void destroy_particle(std::size_t index)
+		{
+			system.destroy_particle<_user_particle_t>(index);
+		}
+
+		/**
+		 * @brief Destroys every particle flagged in `dead`, survivors are moved into the holes and may change index.
+		 *        Indices cached by the accelerator are stale until the next `begin_update()`, which rebuilds it.
+		 * @return The number of destroyed particles.
+		 * @details 批量删除粒子
+		 */
+		template<typename _user_particle_t>
+		std::size_t destroy_particles(std::span<const uint8_t> dead)
+		{
+			return system.destroy_particles<_user_particle_t>(dead);
+		}
+
 		/**
 		 * @brief Retrieves the given attribute of all particle instances.
 		 * @details 返回粒子属性
@@ -79,6 +147,29 @@ namespace se
 			system.for_each<_user_particle_t, attrs...>(std::move(callable));
 		}
 
+		/**
+		 * @brief Invokes `callable(index, attributes...)` for all particle instances on the engine thread pool, used to query.
+		 *        The callable runs concurrently and must not write shared state.
+		 * @details 多线程查询粒子属性
+		 */
+		template<typename _user_particle_t, ecs::string_literal... attrs>
+		void par_query_for_each(auto&& callable) const
+		{
+			system.par_for_each<_user_particle_t, attrs...>(callable);
+		}
+
+		/**
+		 * @brief Invokes `callable(index, attributes...)` for all particle instances on the engine thread pool, used to update.
+		 *        The callable runs concurrently, it may write the attributes it is given and read the accelerator,
+		 *        which is not changed until the next `begin_update()`.
+		 * @details 多线程更新粒子属性
+		 */
+		template<typename _user_particle_t, ecs::string_literal... attrs>
+		void par_update_for_each(auto&& callable)
+		{
+			system.par_for_each<_user_particle_t, attrs...>(callable);
+		}
+
 		/**
 		 * @brief Calls before update all particles.
 		 * @details 准备更新粒子属性
@@ -86,8 +177,81 @@ namespace se
 		template<typename _user_particle_t>
 		[[msvc::forceinline]] void begin_update()
 		{
-			// TOFIX
-			accel.rebuild(query_any_of<_user_particle_t, attribute_list::position>());
+			wrap_positions<_user_particle_t>();
+			if constexpr (requires { accel.update(std::span<const _vector_t>{}); })
+			{
+				accel.update(query_any_of<_user_particle_t, attribute_list::position>());
+			}
+			else
+			{
+				accel.rebuild(query_any_of<_user_particle_t, attribute_list::position>());
+			}
+		}
+
+		/**
+		 * @brief Calls before update all particles, the accelerator and the neighbor list are only rebuilt
+		 *        once some particle has moved more than half of the skin, otherwise only positions are cached.
+		 * @return true if the neighbor list was rebuilt.
+		 * @details 准备更新粒子属性（使用 Verlet 邻居列表）
+		 */
+		template<typename _user_particle_t>
+		[[msvc::forceinline]] bool begin_update(verlet_neighbor_list& neighbors) requires std::same_as<_accelerator_t, grid2d_accelerator>
+		{
+			wrap_positions<_user_particle_t>();
+			return neighbors.update(accel, query_any_of<_user_particle_t, attribute_list::position>());
+		}
+
+		/**
+		 * @brief Calls before update all particles, rebuilds the accelerator on the engine thread pool.
+		 * @details 准备更新粒子属性（多线程）
+		 */
+		template<typename _user_particle_t>
+		[[msvc::forceinline]] void par_begin_update()
+		{
+			wrap_positions<_user_particle_t>();
+			if constexpr (requires { accel.par_rebuild(std::span<const _vector_t>{}); })
+			{
+				accel.par_rebuild(query_any_of<_user_particle_t, attribute_list::position>());
+			}
+			else
+			{
+				accel.rebuild(query_any_of<_user_particle_t, attribute_list::position>());
+			}
+		}
+
+		/**
+		 * @brief Calls before update all particles, snapshots positions and rebuilds the back grid of `buffered`
+		 *        on its background thread. Readers keep querying the published grid meanwhile.
+		 * @details 准备更新粒子属性（后台异步重建网格）
+		 */
+		template<typename _user_particle_t>
+		[[msvc::forceinline]] void async_begin_update(double_buffered_accelerator& buffered) requires std::same_as<_vector_t, vec2>
+		{
+			wrap_positions<_user_particle_t>();
+			buffered.begin_rebuild(query_any_of<_user_particle_t, attribute_list::position>());
+		}
+
+		/**
+		 * @brief Rebuilds `broad` from the position and `radius` attributes, then finds the overlapping particles.
+		 * @return The pairs, valid until the next call on `broad`.
+		 * @details 粗检测：查找所有重叠的粒子对，粒子需注册 radius 属性
+		 */
+		template<typename _user_particle_t>
+		std::span<const contact_pair> find_contacts(broad_phase2d& broad) requires std::same_as<_vector_t, vec2>
+		{
+			broad.rebuild(query_any_of<_user_particle_t, attribute_list::position>(), query_any_of<_user_particle_t, attribute_list::radius>());
+			return broad.find_pairs();
+		}
+
+		/**
+		 * @brief Same as `find_contacts()`, the pairs are found on the engine thread pool.
+		 * @details 粗检测（多线程）
+		 */
+		template<typename _user_particle_t>
+		std::span<const contact_pair> par_find_contacts(broad_phase2d& broad) requires std::same_as<_vector_t, vec2>
+		{
+			broad.rebuild(query_any_of<_user_particle_t, attribute_list::position>(), query_any_of<_user_particle_t, attribute_list::radius>());
+			return broad.par_find_pairs();
 		}
 
 		/**
@@ -97,14 +261,101 @@ namespace se
 		template<typename _user_particle_t>
 		[[msvc::forceinline]] void end_update()
 		{
-			// TODO
+			if (spatial_sort_interval != 0 && ++frame_count % spatial_sort_interval == 0)
+			{
+				spatial_sort<_user_particle_t>();
+			}
+		}
+
+		/**
+		 * @brief Sorts particles every `frames` frames in `end_update()`, 0 disables it.
+		 * @details 设置空间排序的间隔帧数
+		 */
+		void set_spatial_sort_interval(uint32_t frames) noexcept
+		{
+			spatial_sort_interval = frames;
+			frame_count = 0;
+		}
+
+		/**
+		 * @brief Reorders all attributes of all particle instances by the Z-order (Morton) code of their position,
+		 *        so that particles near in space are near in memory.
+		 * @details 按位置的 Morton 码重排粒子，使空间上相邻的粒子在内存中也相邻
+		 */
+		template<typename _user_particle_t>
+		void spatial_sort()
+		{
+			std::span<const _vector_t> positions = query_any_of<_user_particle_t, attribute_list::position>();
+
+			// Morton code in the high bits, original index in the low bits.
+			spatial_keys.resize(positions.size());
+			for (std::size_t i = 0; i < positions.size(); ++i)
+			{
+				spatial_keys[i] = (uint64_t(morton_code_of(positions[i])) << 32) | uint64_t(i);
+			}
+			std::sort(spatial_keys.begin(), spatial_keys.end());
+
+			spatial_order.resize(positions.size());
+			for (std::size_t i = 0; i < positions.size(); ++i)
+			{
+				spatial_order[i] = uint32_t(spatial_keys[i]);
+			}
+			system.permute<_user_particle_t>(spatial_order);
 		}
 
 
 	private:
+		template <typename... _args_t>
+		[[nodiscard]] static _accelerator_t make_accelerator(size_type const& in_scene_size, _args_t&&... args)
+		{
+			if constexpr (std::is_constructible_v<_accelerator_t, size_type const&, _args_t...>)
+			{
+				return _accelerator_t(in_scene_size, std::forward<_args_t>(args)...);
+			}
+			else
+			{
+				return _accelerator_t(std::forward<_args_t>(args)...);
+			}
+		}
+
+		/** Z-order code of a position in the scene, 16 bits per axis in 2D, 10 bits per axis in 3D. */
+		[[nodiscard]] uint32_t morton_code_of(_vector_t const& position) const noexcept
+		{
+			if constexpr (std::same_as<_vector_t, vec3>)
+			{
+				const float scale_x = 1023.f / std::max(size.x, 1);
+				const float scale_y = 1023.f / std::max(size.y, 1);
+				const float scale_z = 1023.f / std::max(size.z, 1);
+				const uint16_t x = (uint16_t)std::clamp(position.x * scale_x, 0.f, 1023.f);
+				const uint16_t y = (uint16_t)std::clamp(position.y * scale_y, 0.f, 1023.f);
+				const uint16_t z = (uint16_t)std::clamp(position.z * scale_z, 0.f, 1023.f);
+				return math::morton_encode(x, y, z);
+			}
+			else
+			{
+				const float scale_x = 65535.f / std::max(size.x, 1);
+				const float scale_y = 65535.f / std::max(size.y, 1);
+				const uint16_t x = (uint16_t)std::clamp(position.x * scale_x, 0.f, 65535.f);
+				const uint16_t y = (uint16_t)std::clamp(position.y * scale_y, 0.f, 65535.f);
+				return math::morton_encode(x, y);
+			}
+		}
+
+		template<typename _user_particle_t>
+		[[msvc::forceinline]] void wrap_positions()
+		{
+			if constexpr (std::same_as<_accelerator_t, grid2d_accelerator>)
+			{
+				if (accel.get_boundary() == grid_boundary::periodic)
+				{
+					accel.wrap(system.any_of<_user_particle_t, attribute_list::position>());
+				}
+			}
+		}
+
 		/** Non-copyable. */
-		scene2d(const scene2d&) = delete;
-		scene2d& operator = (const scene2d&) = delete;
+		basic_scene(const basic_scene&) = delete;
+		basic_scene& operator = (const basic_scene&) = delete;
 
 		/** Disable new. */
 		void* operator new (std::size_t, void*) = delete;
@@ -113,8 +364,68 @@ namespace se
 
 
 
-	scene2d make_scene(vec2i const& in_scene_size)
+	/**
+	 * @brief A 2D particle scene, indexed by a uniform grid unless `_accelerator_t` says otherwise.
+	 * @details 二维粒子场景
+	 */
+	template <accelerator<vec2> _accelerator_t = grid2d_accelerator>
+	class scene2d : public basic_scene<vec2, _accelerator_t>
+	{
+	protected:
+		using basic_scene<vec2, _accelerator_t>::basic_scene;
+
+
+	public:
+		friend scene2d<> make_scene(vec2i const& in_scene_size, grid_layout in_layout, float in_cell_size);
+
+		template <accelerator _other_t, typename... _args_t>
+		friend scene2d<_other_t> make_scene(vec2i const& in_scene_size, _args_t&&... args);
+	};
+
+
+
+	/**
+	 * @brief A 3D particle scene, particles register a `vec3` position.
+	 * @details 三维粒子场景
+	 */
+	template <accelerator<vec3> _accelerator_t = grid3d_accelerator>
+	class scene3d : public basic_scene<vec3, _accelerator_t>
+	{
+	protected:
+		using basic_scene<vec3, _accelerator_t>::basic_scene;
+
+
+	public:
+		friend scene3d<> make_scene(vec3i const& in_scene_size, float in_cell_size);
+	};
+
+
+
+	/**
+	 * @param in_cell_size Width of an accelerator cell, best set to the most frequent interaction radius.
+	 */
+	inline scene2d<> make_scene(vec2i const& in_scene_size, grid_layout in_layout = grid_layout::linked_list, float in_cell_size = grid2d_accelerator::default_cell_size)
+	{
+		return scene2d<>(in_scene_size, in_layout, in_cell_size);
+	}
+
+	/**
+	 * @brief Makes a scene indexed by `_accelerator_t`, e.g. `make_scene<quadtree2d_accelerator>(size, 8)`.
+	 * @param args Arguments of the accelerator after the scene size, or all of them if it takes no scene size.
+	 */
+	template <accelerator _accelerator_t, typename... _args_t>
+	scene2d<_accelerator_t> make_scene(vec2i const& in_scene_size, _args_t&&... args)
+	{
+		return scene2d<_accelerator_t>(in_scene_size, std::forward<_args_t>(args)...);
+	}
+
+
+
+	/**
+	 * @param in_cell_size Width of an accelerator cell, best set to the most frequent interaction radius.
+	 */
+	inline scene3d<> make_scene(vec3i const& in_scene_size, float in_cell_size = grid3d_accelerator::default_cell_size)
 	{
-		return scene2d(in_scene_size);
+		return scene3d<>(in_scene_size, in_cell_size);
 	}
 }
\ No newline at end of file